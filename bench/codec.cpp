@@ -0,0 +1,158 @@
+#include "../include/packer.hpp"
+#include "../include/msgs/camera.hpp"
+#include "../include/msgs/geometry.hpp"
+#include "../include/msgs/point-cloud.hpp"
+#include "../include/msgs/robot.hpp"
+
+#include <benchmark/benchmark.h>
+#include <sstream>
+
+using namespace is::msg;
+
+/*
+  Compares the direct codec used by is::msgpack against the generic
+  msgpack::object path (unpack -> object -> convert) it replaced. Before
+  timing, direct_decode checks that both paths decode the same message,
+  comparing their results packed again, and that an array length larger
+  than the body is rejected instead of allocated, failing the benchmark
+  otherwise.
+*/
+
+geometry::PointsWithReference make_points(int64_t n) {
+  geometry::PointsWithReference points;
+  points.reference = "camera.0";
+  for (int64_t i = 0; i < n; ++i) {
+    geometry::Point point{i * 0.5, i * -0.25};
+    if (i % 2) {
+      point.z = i * 2.0;
+    }
+    points.points.push_back(point);
+  }
+  return points;
+}
+
+template <geometry::PointEncoding encoding>
+geometry::PointCloud make_cloud(int64_t n) {
+  auto cloud = geometry::to_point_cloud(make_points(n));
+  cloud.encoding = encoding;
+  cloud.resolution = 0.001;
+  return cloud;
+}
+
+camera::TheoraPacket make_packet(int64_t n) {
+  return camera::TheoraPacket{false, std::vector<unsigned char>(n, 0xab)};
+}
+
+robot::Pose make_pose(int64_t) {
+  return robot::Pose{{1200.5, -300.25, boost::none}, 1.57};
+}
+
+std::vector<bool> make_flags(int64_t n) {
+  std::vector<bool> flags;
+  for (int64_t i = 0; i < n; ++i) {
+    flags.push_back(i % 3 == 0);
+  }
+  return flags;
+}
+
+template <typename T>
+bool decoders_agree(std::string const& body) {
+  msgpack::object_handle handle = msgpack::unpack(body.data(), body.size());
+  T object;
+  handle.get().convert(object);
+  auto direct = is::codec::decode<T>(body.data(), body.size());
+  return is::pack(direct) == is::pack(object);
+}
+
+// A 5 byte body claiming 4G elements must throw before anything is allocated
+template <typename T>
+bool rejects_oversized_array() {
+  const char body[] = {'\xdd', '\xff', '\xff', '\xff', '\xff'};
+  try {
+    is::codec::decode<T>(body, sizeof body);
+  } catch (msgpack::type_error const&) {
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+void object_decode(benchmark::State& state, T (*make)(int64_t)) {
+  auto body = is::pack(make(state.range(0)));
+  for (auto _ : state) {
+    msgpack::object_handle handle = msgpack::unpack(body.data(), body.size());
+    T data;
+    handle.get().convert(data);
+    benchmark::DoNotOptimize(data);
+  }
+  state.SetBytesProcessed(state.iterations() * body.size());
+}
+
+template <typename T>
+void direct_decode(benchmark::State& state, T (*make)(int64_t)) {
+  auto body = is::pack(make(state.range(0)));
+  if (!decoders_agree<T>(body)) {
+    state.SkipWithError("direct and msgpack::object decoding differ");
+    return;
+  }
+  if (!rejects_oversized_array<T>()) {
+    state.SkipWithError("oversized array length accepted");
+    return;
+  }
+  for (auto _ : state) {
+    auto data = is::codec::decode<T>(body.data(), body.size());
+    benchmark::DoNotOptimize(data);
+  }
+  state.SetBytesProcessed(state.iterations() * body.size());
+}
+
+template <typename T>
+void stream_encode(benchmark::State& state, T (*make)(int64_t)) {
+  auto data = make(state.range(0));
+  for (auto _ : state) {
+    std::stringstream ss;
+    msgpack::pack(ss, data);
+    auto body = ss.str();
+    benchmark::DoNotOptimize(body);
+  }
+}
+
+template <typename T>
+void direct_encode(benchmark::State& state, T (*make)(int64_t)) {
+  auto data = make(state.range(0));
+  for (auto _ : state) {
+    auto body = is::codec::encode(data);
+    benchmark::DoNotOptimize(body);
+  }
+}
+
+BENCHMARK_CAPTURE(object_decode, points, make_points)->Range(8, 8 << 10);
+BENCHMARK_CAPTURE(direct_decode, points, make_points)->Range(8, 8 << 10);
+BENCHMARK_CAPTURE(object_decode, pose, make_pose)->Arg(1);
+BENCHMARK_CAPTURE(direct_decode, pose, make_pose)->Arg(1);
+BENCHMARK_CAPTURE(object_decode, theora_packet, make_packet)->Range(64, 64 << 10);
+BENCHMARK_CAPTURE(direct_decode, theora_packet, make_packet)->Range(64, 64 << 10);
+BENCHMARK_CAPTURE(object_decode, flags, make_flags)->Arg(64);
+BENCHMARK_CAPTURE(direct_decode, flags, make_flags)->Arg(64);
+
+BENCHMARK_CAPTURE(stream_encode, points, make_points)->Range(8, 8 << 10);
+BENCHMARK_CAPTURE(direct_encode, points, make_points)->Range(8, 8 << 10);
+BENCHMARK_CAPTURE(stream_encode, pose, make_pose)->Arg(1);
+BENCHMARK_CAPTURE(direct_encode, pose, make_pose)->Arg(1);
+BENCHMARK_CAPTURE(stream_encode, theora_packet, make_packet)->Range(64, 64 << 10);
+BENCHMARK_CAPTURE(direct_encode, theora_packet, make_packet)->Range(64, 64 << 10);
+
+BENCHMARK_CAPTURE(direct_decode, cloud_float64, make_cloud<geometry::PointEncoding::float64>)
+    ->Range(8, 128 << 10);
+BENCHMARK_CAPTURE(direct_decode, cloud_float32, make_cloud<geometry::PointEncoding::float32>)
+    ->Range(8, 128 << 10);
+BENCHMARK_CAPTURE(direct_decode, cloud_quantized16,
+                  make_cloud<geometry::PointEncoding::quantized16>)
+    ->Range(8, 128 << 10);
+BENCHMARK_CAPTURE(direct_encode, cloud_float64, make_cloud<geometry::PointEncoding::float64>)
+    ->Range(8, 128 << 10);
+BENCHMARK_CAPTURE(direct_encode, cloud_quantized16,
+                  make_cloud<geometry::PointEncoding::quantized16>)
+    ->Range(8, 128 << 10);
+
+BENCHMARK_MAIN();
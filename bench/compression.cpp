@@ -0,0 +1,96 @@
+#include "../include/packer.hpp"
+#include "../include/msgs/common.hpp"
+#include "../include/msgs/cv.hpp"
+#include "../include/msgs/geometry.hpp"
+#include "../include/msgs/point-cloud.hpp"
+
+#include <benchmark/benchmark.h>
+#include <opencv2/imgproc.hpp>
+
+using namespace is::msg;
+
+/*
+  Compression ratio and latency of every registered codec per message type.
+  Build with -DIS_WITH_LZ4 -llz4 and/or -DIS_WITH_ZSTD -lzstd, otherwise
+  there is nothing to measure. The "ratio" counter is compressed/original size.
+*/
+
+geometry::PointsWithReference make_points() {
+  geometry::PointsWithReference points{"camera.0", {}};
+  for (int i = 0; i < 10000; ++i) {
+    points.points.push_back(geometry::Point{(i % 640) * 1.0, (i / 640) * 1.0, 1000.0 + i % 7});
+  }
+  return points;
+}
+
+geometry::PointCloud make_cloud() {
+  auto cloud = geometry::to_point_cloud(make_points());
+  cloud.encoding = geometry::PointEncoding::quantized16;
+  cloud.resolution = 0.01;
+  return cloud;
+}
+
+common::EntityList make_entities() {
+  common::EntityList entities;
+  for (int i = 0; i < 1000; ++i) {
+    entities.list.push_back("ptgrey.camera." + std::to_string(i));
+  }
+  return entities;
+}
+
+cv::Mat make_mat() {
+  cv::Mat mat(480, 640, CV_8UC3);
+  for (int r = 0; r < mat.rows; ++r) {
+    for (int c = 0; c < mat.cols; ++c) {
+      mat.at<cv::Vec3b>(r, c) = cv::Vec3b(r % 256, c % 256, (r + c) % 256);
+    }
+  }
+  cv::GaussianBlur(mat, mat, cv::Size(5, 5), 0);
+  return mat;
+}
+
+template <typename T>
+void compress(benchmark::State& state, is::compression::Codec* codec, T const& data) {
+  auto body = is::pack(data);
+  std::string out;
+  for (auto _ : state) {
+    codec->compress(body.data(), body.size(), out);
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetBytesProcessed(state.iterations() * body.size());
+  state.counters["ratio"] = static_cast<double>(out.size()) / body.size();
+}
+
+template <typename T>
+void decompress(benchmark::State& state, is::compression::Codec* codec, T const& data) {
+  auto body = is::pack(data);
+  std::string compressed, out;
+  codec->compress(body.data(), body.size(), compressed);
+  for (auto _ : state) {
+    codec->decompress(compressed.data(), compressed.size(), out);
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetBytesProcessed(state.iterations() * body.size());
+  state.counters["ratio"] = static_cast<double>(compressed.size()) / body.size();
+}
+
+template <typename T>
+void add(std::string const& type, T const& data) {
+  for (auto&& key_value : is::compression::registry()) {
+    auto codec = key_value.second.get();
+    benchmark::RegisterBenchmark(("compress/" + type + "/" + key_value.first).c_str(),
+                                 compress<T>, codec, data);
+    benchmark::RegisterBenchmark(("decompress/" + type + "/" + key_value.first).c_str(),
+                                 decompress<T>, codec, data);
+  }
+}
+
+int main(int argc, char** argv) {
+  add("points", make_points());
+  add("point_cloud", make_cloud());
+  add("entity_list", make_entities());
+  add("mat", make_mat());
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+}
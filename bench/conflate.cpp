@@ -0,0 +1,83 @@
+#include "../include/conflating-subscriber.hpp"
+
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/*
+  LatestSlot (conflating subscriptions) against a mutex protected slot, with
+  one writer thread publishing as fast as possible and the benchmark thread
+  reading the newest value.
+*/
+
+struct MutexSlot {
+  std::mutex mutex;
+  is::Envelope::ptr_t envelope;
+  uint64_t written = 0;
+  uint64_t read = 0;
+
+  void write(is::Envelope::ptr_t value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    envelope = std::move(value);
+    ++written;
+  }
+
+  bool take(is::Envelope::ptr_t& value, uint64_t& skipped) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (envelope == nullptr)
+      return false;
+    value = std::move(envelope);
+    skipped = written - read - 1;
+    read = written;
+    return true;
+  }
+};
+
+is::Envelope::ptr_t make_envelope() {
+  return is::Envelope::Create(is::BasicMessage::Create("frame"), "", 0, "data", false,
+                              "webcam.frame", 1);
+}
+
+template <typename Slot>
+void take_latest(benchmark::State& state) {
+  Slot slot;
+  std::atomic<bool> running{true};
+  std::thread writer([&]() {
+    auto envelope = make_envelope();
+    while (running) {
+      slot.write(envelope);
+    }
+  });
+
+  uint64_t taken = 0, skipped = 0;
+  for (auto _ : state) {
+    is::Envelope::ptr_t envelope;
+    uint64_t n;
+    if (slot.take(envelope, n)) {
+      ++taken;
+      skipped += n;
+    }
+    benchmark::DoNotOptimize(envelope);
+  }
+  running = false;
+  writer.join();
+  state.counters["taken"] = taken;
+  state.counters["skipped"] = skipped;
+}
+
+template <typename Slot>
+void write_latest(benchmark::State& state) {
+  Slot slot;
+  auto envelope = make_envelope();
+  for (auto _ : state) {
+    slot.write(envelope);
+  }
+}
+
+BENCHMARK_TEMPLATE(take_latest, is::LatestSlot)->UseRealTime();
+BENCHMARK_TEMPLATE(take_latest, MutexSlot)->UseRealTime();
+BENCHMARK_TEMPLATE(write_latest, is::LatestSlot);
+BENCHMARK_TEMPLATE(write_latest, MutexSlot);
+
+BENCHMARK_MAIN();
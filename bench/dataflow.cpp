@@ -0,0 +1,64 @@
+#include "../include/dataflow.hpp"
+
+#include <benchmark/benchmark.h>
+#include <numeric>
+
+/*
+  Values through a chain of dataflow nodes, with in-process edges against
+  packing and unpacking the value at every hop, as a chain of processes
+  connected by the broker would (without the broker round trips). Each run
+  pushes 256 values through 'stages' nodes.
+*/
+
+constexpr int values_per_run = 256;
+
+std::vector<float> make_value(size_t size) {
+  std::vector<float> value(size);
+  std::iota(value.begin(), value.end(), 0.0f);
+  return value;
+}
+
+template <typename T, typename Stage>
+void run_chain(benchmark::State& state, T const& value, Stage&& stage) {
+  for (auto _ : state) {
+    is::dataflow::Graph graph("amqp://localhost");
+    int n = 0;
+    auto stream = graph.generate<T>("source", [&](T& out) {
+      out = value;
+      return n++ < values_per_run;
+    });
+    for (int i = 0; i < state.range(1); ++i) {
+      stream = graph.map("stage" + std::to_string(i), stream, stage);
+    }
+    graph.sink("sink", stream, [](T& in) { benchmark::DoNotOptimize(in); });
+    graph.start();
+    graph.wait();
+  }
+  state.SetItemsProcessed(state.iterations() * values_per_run);
+}
+
+void in_process(benchmark::State& state) {
+  run_chain(state, make_value(state.range(0)), [](std::vector<float>& in) {
+    in[0] += 1.0f;
+    return std::move(in);
+  });
+}
+
+void serialized(benchmark::State& state) {
+  run_chain(state, is::pack(make_value(state.range(0))), [](std::string& in) {
+    auto value = is::codec::decode<std::vector<float>>(in.data(), in.size());
+    value[0] += 1.0f;
+    return is::pack(value);
+  });
+}
+
+#define SIZES ->Args({16, 3})->Args({16384, 3})->Args({1 << 20, 3})
+
+BENCHMARK(in_process) SIZES ->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(serialized) SIZES ->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+int main(int argc, char** argv) {
+  is::logger()->set_level(spdlog::level::warn);
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+}
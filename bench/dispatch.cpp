@@ -0,0 +1,133 @@
+#include "../include/msgs/camera.hpp"
+#include "../include/packer.hpp"
+#include "../include/service-provider.hpp"
+
+#include <benchmark/benchmark.h>
+#include <mutex>
+
+/*
+  ServiceProvider request dispatch (ServiceDispatcher) against a mock channel
+  that only records the published replies.
+*/
+
+struct MockChannel {
+  size_t published = 0;
+  size_t bytes = 0;
+
+  void BasicPublish(std::string const&, std::string const&, is::BasicMessage::ptr_t message,
+                    bool) {
+    ++published;
+    bytes += message->Body().size();
+  }
+};
+
+is::Request make_request(std::string const& route, int value) {
+  auto message = is::msgpack(value);
+  message->CorrelationId("0");
+  message->ReplyTo("amq.gen-reply");
+  return is::Envelope::Create(message, "", 0, "services", false, route, 1);
+}
+
+void dispatch(benchmark::State& state) {
+  is::ServiceDispatcher dispatcher;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    dispatcher.add("math." + std::to_string(i), [](is::Request request) {
+      return is::msgpack(is::msgpack<int>(request) + 1);
+    });
+  }
+
+  auto request = make_request("math.0", 41);
+  MockChannel channel;
+  for (auto _ : state) {
+    dispatcher.dispatch(channel, request);
+  }
+  state.SetItemsProcessed(channel.published);
+}
+
+// Wildcard services, looked up in the topic trie after missing the exact topics
+void dispatch_pattern(benchmark::State& state) {
+  is::ServiceDispatcher dispatcher;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    dispatcher.add("device." + std::to_string(i) + ".*", [](is::Request request) {
+      return is::msgpack(is::msgpack<int>(request) + 1);
+    });
+  }
+  dispatcher.add("device.#", [](is::Request) { return is::msgpack(0); });
+
+  auto request = make_request("device.0.get_status", 41);
+  MockChannel channel;
+  for (auto _ : state) {
+    dispatcher.dispatch(channel, request);
+  }
+  state.SetItemsProcessed(channel.published);
+}
+
+void dispatch_invalid(benchmark::State& state) {
+  is::ServiceDispatcher dispatcher;
+  dispatcher.add("math.increment", [](is::Request) { return is::msgpack(0); });
+
+  auto request = make_request("math.unknown", 0);
+  MockChannel channel;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dispatcher.dispatch(channel, request));
+  }
+}
+
+// Requests whose deadline passed are dropped before running the service
+void dispatch_expired(benchmark::State& state) {
+  is::ServiceDispatcher dispatcher;
+  dispatcher.add("math.increment", [](is::Request request) {
+    return is::msgpack(is::msgpack<int>(request) + 1);
+  });
+
+  auto request = make_request("math.increment", 41);
+  is::set_deadline(request->Message(), std::chrono::system_clock::now() - std::chrono::seconds(1));
+  MockChannel channel;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dispatcher.dispatch(channel, request));
+  }
+  state.counters["expired"] = dispatcher.stats().expired.load();
+}
+
+// Header-like service (a few KB of packets copied under a lock), with and without cache
+void dispatch_headers(benchmark::State& state) {
+  std::mutex mutex;
+  std::vector<is::msg::camera::TheoraPacket> headers{
+      {true, std::vector<unsigned char>(42, 1)},
+      {false, std::vector<unsigned char>(3000, 2)},
+      {false, std::vector<unsigned char>(1500, 3)}};
+  auto get_headers = [&](is::Request) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto copy = headers;
+    lock.unlock();
+    return is::msgpack(copy);
+  };
+
+  is::ServiceDispatcher dispatcher;
+  if (state.range(0)) {
+    dispatcher.add("webcam.get_headers", get_headers, is::CachePolicy{});
+  } else {
+    dispatcher.add("webcam.get_headers", get_headers);
+  }
+
+  auto request = make_request("webcam.get_headers", 0);
+  MockChannel channel;
+  for (auto _ : state) {
+    dispatcher.dispatch(channel, request);
+  }
+  state.SetItemsProcessed(channel.published);
+  state.SetLabel(state.range(0) ? "cached" : "uncached");
+}
+
+BENCHMARK(dispatch)->Arg(1)->Arg(64);
+BENCHMARK(dispatch_pattern)->Arg(1)->Arg(64);
+BENCHMARK(dispatch_headers)->Arg(0)->Arg(1);
+BENCHMARK(dispatch_invalid);
+BENCHMARK(dispatch_expired);
+
+int main(int argc, char** argv) {
+  // Request logging would dominate the measurement
+  is::logger()->set_level(spdlog::level::err);
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+}
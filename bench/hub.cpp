@@ -0,0 +1,89 @@
+#include "../include/frame-hub.hpp"
+#include "../include/theora-encoder.hpp"
+
+#include <benchmark/benchmark.h>
+
+/*
+  Cost per packet of serving N in-process consumers of one camera stream: one
+  decoder per consumer against a single FrameStream fanning out each frame.
+*/
+
+std::vector<cv::Mat> make_frames(int width, int height, int n) {
+  std::vector<cv::Mat> frames;
+  for (int i = 0; i < n; ++i) {
+    cv::Mat frame(height, width, CV_8UC3);
+    for (int r = 0; r < height; ++r) {
+      for (int c = 0; c < width; ++c) {
+        frame.at<cv::Vec3b>(r, c) = cv::Vec3b((r + i) % 256, (c + 2 * i) % 256, (r + c) % 256);
+      }
+    }
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+struct Stream {
+  std::vector<is::TheoraPacket> headers;
+  std::vector<is::TheoraPacket> packets;  // One keyframe interval, so it can be looped
+};
+
+Stream make_stream(int width, int height) {
+  is::TheoraEncoder encoder;
+  Stream stream;
+  for (auto&& frame : make_frames(width, height, 64)) {
+    for (auto&& packet : encoder.encode(frame)) {
+      stream.packets.push_back(packet);
+    }
+  }
+  stream.headers = encoder.get_headers();
+  stream.packets.erase(stream.packets.begin(), stream.packets.begin() + stream.headers.size());
+  return stream;
+}
+
+void decoder_per_consumer(benchmark::State& state) {
+  auto stream = make_stream(640, 480);
+  std::vector<std::unique_ptr<is::TheoraDecoder>> decoders;
+  for (int i = 0; i < state.range(0); ++i) {
+    decoders.emplace_back(new is::TheoraDecoder);
+    decoders.back()->set_headers(stream.headers);
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    auto&& packet = stream.packets[i++ % stream.packets.size()];
+    for (auto&& decoder : decoders) {
+      benchmark::DoNotOptimize(decoder->decode(packet));
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void shared_decoder(benchmark::State& state) {
+  auto stream = make_stream(640, 480);
+  is::FrameStream frames("webcam.frame");
+  frames.set_headers(stream.headers);
+  std::vector<std::shared_ptr<is::FrameQueue>> queues;
+  for (int i = 0; i < state.range(0); ++i) {
+    queues.push_back(std::make_shared<is::FrameQueue>());
+    frames.add(queues.back());
+  }
+
+  size_t i = 0;
+  is::FramePtr frame;
+  for (auto _ : state) {
+    frames.feed(stream.packets[i++ % stream.packets.size()], 0);
+    for (auto&& queue : queues) {
+      queue->try_pop(frame);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(decoder_per_consumer)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond);
+BENCHMARK(shared_decoder)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+  is::logger()->set_level(spdlog::level::warn);
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+}
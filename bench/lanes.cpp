@@ -0,0 +1,133 @@
+#include "../include/priority-lanes.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <mutex>
+#include <numeric>
+
+/*
+  Latency of a control message while a video stream keeps a backlog of 64 KB
+  frames waiting, consumed through strict priority lanes (2 lanes, control
+  first) or a single FIFO lane (1). The consumer makes a pass over the body of
+  every frame it takes, standing in for decoding.
+
+  control_latency measures the in-process LaneScheduler only. broker_latency
+  goes through PriorityLanes and a broker, so it also covers the frames queued
+  ahead of the command in the same connection; it needs IS_BENCH_URI (e.g.
+  amqp://localhost) and is skipped otherwise.
+*/
+
+is::Envelope::ptr_t make_envelope(std::string const& topic, size_t bytes) {
+  return is::Envelope::Create(is::BasicMessage::Create(std::string(bytes, 'x')), "", 0, "data",
+                              false, topic, 1);
+}
+
+uint64_t checksum_of(is::Envelope::ptr_t const& envelope) {
+  auto&& body = envelope->Message()->Body();
+  return std::accumulate(body.begin(), body.end(), uint64_t(0));
+}
+
+void control_latency(benchmark::State& state) {
+  const size_t n_lanes = state.range(0);
+  const size_t backlog = 64;
+  is::LaneScheduler scheduler(n_lanes, 4 * backlog);
+  auto frame = make_envelope("webcam.frame", 64 << 10);
+  auto control = make_envelope("robot.0.speed", 16);
+
+  std::atomic<bool> running{true};
+  std::thread video([&]() {
+    while (running) {
+      if (scheduler.pending(n_lanes - 1) < backlog) {
+        scheduler.push(n_lanes - 1, frame);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint64_t frames = 0;
+  uint64_t checksum = 0;
+  for (auto _ : state) {
+    // Full load: the backlog is there whenever a control message arrives
+    state.PauseTiming();
+    while (scheduler.pending(n_lanes - 1) < backlog) {
+      std::this_thread::yield();
+    }
+    state.ResumeTiming();
+
+    scheduler.push(0, control);
+    for (;;) {
+      auto envelope = scheduler.pop();
+      if (envelope == control)
+        break;
+      checksum += checksum_of(envelope);
+      ++frames;
+    }
+  }
+  running = false;
+  video.join();
+
+  benchmark::DoNotOptimize(checksum);
+  state.counters["frames_per_control"] = static_cast<double>(frames) / state.iterations();
+}
+
+void broker_latency(benchmark::State& state) {
+  auto uri = std::getenv("IS_BENCH_URI");
+  if (uri == nullptr) {
+    state.SkipWithError("IS_BENCH_URI is not set");
+    return;
+  }
+  std::vector<is::Lane> config{{"control", {"bench.control"}, 9}, {"bulk", {"#"}, 0}};
+  if (state.range(0) == 1) {
+    config = {{"all", {"#"}, 0}};
+  }
+  is::PriorityLanes lanes(uri, config);
+  lanes.subscribe({"bench.control", "bench.frame"}, "data", 64);
+
+  // A single lane is also a single publishing connection, shared with the video thread
+  std::mutex publishing;
+  auto publish = [&](std::string const& topic, std::string const& body) {
+    auto message = is::BasicMessage::Create(body);
+    std::unique_lock<std::mutex> lock(publishing, std::defer_lock);
+    if (config.size() == 1) {
+      lock.lock();
+    }
+    lanes.publish(topic, message);
+  };
+
+  std::atomic<bool> running{true};
+  std::thread video([&]() {
+    std::string frame(64 << 10, 'x');
+    while (running) {
+      publish("bench.frame", frame);
+    }
+  });
+
+  uint64_t frames = 0;
+  uint64_t checksum = 0;
+  for (auto _ : state) {
+    publish("bench.control", "stop");
+    for (;;) {
+      // The broker drops the oldest messages of a full queue, the command included
+      auto envelope = lanes.consume_for(std::chrono::seconds(1));
+      if (envelope == nullptr) {
+        state.SkipWithError("control message lost");
+        break;
+      }
+      if (envelope->RoutingKey() == "bench.control")
+        break;
+      checksum += checksum_of(envelope);
+      ++frames;
+    }
+  }
+  running = false;
+  video.join();
+
+  benchmark::DoNotOptimize(checksum);
+  state.counters["frames_per_control"] = static_cast<double>(frames) / state.iterations();
+}
+
+BENCHMARK(control_latency)->Arg(1)->Arg(2)->UseRealTime();
+BENCHMARK(broker_latency)->Arg(1)->Arg(2)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
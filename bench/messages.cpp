@@ -0,0 +1,114 @@
+#include "../include/packer.hpp"
+#include "../include/msgs/batch.hpp"
+#include "../include/msgs/camera.hpp"
+#include "../include/msgs/common.hpp"
+#include "../include/msgs/cv.hpp"
+#include "../include/msgs/geometry.hpp"
+#include "../include/msgs/point-cloud.hpp"
+#include "../include/msgs/robot.hpp"
+
+#include <benchmark/benchmark.h>
+
+using namespace is::msg;
+
+/*
+  is::pack, is::msgpack(T) and is::msgpack<T>(Envelope) for every message type.
+*/
+
+template <typename T>
+void pack(benchmark::State& state, T const& data) {
+  for (auto _ : state) {
+    auto body = is::pack(data);
+    benchmark::DoNotOptimize(body);
+  }
+  state.SetBytesProcessed(state.iterations() * is::pack(data).size());
+}
+
+template <typename T>
+void to_message(benchmark::State& state, T const& data) {
+  for (auto _ : state) {
+    auto message = is::msgpack(data);
+    benchmark::DoNotOptimize(message);
+  }
+  state.SetBytesProcessed(state.iterations() * is::pack(data).size());
+}
+
+template <typename T>
+void from_envelope(benchmark::State& state, T const& data) {
+  auto envelope = is::Envelope::Create(is::msgpack(data), "", 0, "data", false, "bench", 1);
+  for (auto _ : state) {
+    auto decoded = is::msgpack<T>(envelope);
+    benchmark::DoNotOptimize(decoded);
+  }
+  state.SetBytesProcessed(state.iterations() * is::pack(data).size());
+}
+
+template <typename T>
+void add(std::string const& name, T const& data) {
+  benchmark::RegisterBenchmark(("pack/" + name).c_str(), pack<T>, data);
+  benchmark::RegisterBenchmark(("msgpack/" + name).c_str(), to_message<T>, data);
+  benchmark::RegisterBenchmark(("msgpack_envelope/" + name).c_str(), from_envelope<T>, data);
+}
+
+geometry::PointsWithReference make_points(int n) {
+  geometry::PointsWithReference points{"camera.0", {}};
+  for (int i = 0; i < n; ++i) {
+    points.points.push_back(geometry::Point{i * 0.5, i * -0.25, i * 2.0});
+  }
+  return points;
+}
+
+common::EntityList make_entities(int n) {
+  common::EntityList entities;
+  for (int i = 0; i < n; ++i) {
+    entities.list.push_back("ptgrey.camera." + std::to_string(i));
+  }
+  return entities;
+}
+
+// 100 poses sampled at 500 Hz
+common::Batch<robot::Pose> make_pose_batch() {
+  common::Batch<robot::Pose> batch;
+  uint64_t timestamp = 1500000000000000000;
+  for (int i = 0; i < 100; ++i) {
+    batch.push_back(robot::Pose{{1200.5 + i, -300.25}, 1.57}, timestamp);
+    timestamp += 2000000 + (i % 3) * 1000;
+  }
+  return batch;
+}
+
+cv::Mat make_mat(int rows, int cols) {
+  cv::Mat mat(rows, cols, CV_8UC3);
+  cv::randu(mat, 0, 255);
+  return mat;
+}
+
+int main(int argc, char** argv) {
+  common::SamplingRate rate;
+  rate.rate = 30.0;
+
+  add("camera/TheoraPacket/1k", camera::TheoraPacket{false, std::vector<unsigned char>(1024)});
+  add("camera/TheoraPacket/64k", camera::TheoraPacket{false, std::vector<unsigned char>(65536)});
+  add("camera/CompressedImage/64k",
+      camera::CompressedImage{".jpg", std::vector<unsigned char>(65536)});
+  add("camera/RegionOfInterest", camera::RegionOfInterest{10, 20, 480, 640});
+  add("camera/Resolution", camera::Resolution{480, 640});
+  add("camera/ImageType", camera::image_type::rgb);
+  add("common/Status", common::status::error("device not found"));
+  add("common/Delay", common::Delay{100});
+  add("common/Timestamp", common::Timestamp());
+  add("common/SamplingRate", rate);
+  add("common/EntityList/100", make_entities(100));
+  add("geometry/Point", geometry::Point{1.0, 2.0, 3.0});
+  add("geometry/PointsWithReference/1k", make_points(1000));
+  add("geometry/PointsWithReference/100k", make_points(100000));
+  add("geometry/PointCloud/100k", geometry::to_point_cloud(make_points(100000)));
+  add("robot/Pose", robot::Pose{{1200.5, -300.25}, 1.57});
+  add("robot/Speed", robot::Speed{250.0, 0.1});
+  add("robot/Batch<Pose>/100", make_pose_batch());
+  add("cv/Mat/320x240", make_mat(240, 320));
+  add("cv/Mat/640x480", make_mat(480, 640));
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+}
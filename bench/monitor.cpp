@@ -0,0 +1,49 @@
+#include "../include/topic-monitor.hpp"
+
+#include <benchmark/benchmark.h>
+
+/*
+  Cost of TopicMonitor::record (the budget for 100k msgs/s on one core is
+  10us per message, consuming included) over a number of distinct topics,
+  and of sampling a populated table.
+*/
+
+std::vector<is::Envelope::ptr_t> make_envelopes(int64_t n_topics) {
+  std::vector<is::Envelope::ptr_t> envelopes;
+  for (int64_t i = 0; i < n_topics; ++i) {
+    auto message = is::BasicMessage::Create(std::string(256, 'x'));
+    message->Timestamp(1000 * i);
+    envelopes.push_back(is::Envelope::Create(message, "", 0, "data", false,
+                                             "robot." + std::to_string(i) + ".pose", 1));
+  }
+  return envelopes;
+}
+
+void record(benchmark::State& state) {
+  auto envelopes = make_envelopes(state.range(0));
+  is::TopicMonitor monitor("data", 4096);
+  size_t i = 0;
+  int64_t now = 1000000;
+  for (auto _ : state) {
+    monitor.record(envelopes[i], now);
+    i = (i + 1) % envelopes.size();
+    now += 997;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void sample(benchmark::State& state) {
+  auto envelopes = make_envelopes(state.range(0));
+  is::TopicMonitor monitor("data", 4096);
+  for (auto&& envelope : envelopes) {
+    monitor.record(envelope, 1000000);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(monitor.sample());
+  }
+}
+
+BENCHMARK(record)->Arg(1)->Arg(64)->Arg(1024);
+BENCHMARK(sample)->Arg(64)->Arg(1024);
+
+BENCHMARK_MAIN();
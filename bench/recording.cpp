@@ -0,0 +1,93 @@
+#include "../include/recording.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+
+/*
+  Recording throughput (camera sized messages appended to segments in /tmp)
+  and time seeks over a recording. The seek recording has an empty session
+  (segment) in the middle, and seeks are checked to land on the first record
+  at or after the time before being timed.
+*/
+
+std::string temporary_directory() {
+  char path[] = "/tmp/is-bench-recording-XXXXXX";
+  return mkdtemp(path);
+}
+
+void remove_directory(std::string const& directory) {
+  for (auto segment : is::recording::detail::list_segments(directory)) {
+    std::remove(is::recording::detail::segment_path(directory, segment, "log").c_str());
+    std::remove(is::recording::detail::segment_path(directory, segment, "idx").c_str());
+  }
+  rmdir(directory.c_str());
+}
+
+void append(benchmark::State& state) {
+  auto directory = temporary_directory();
+  auto message = is::BasicMessage::Create(std::string(state.range(0), 'x'));
+  message->ContentEncoding("msgpack");
+  message->Timestamp(1);
+  auto envelope = is::Envelope::Create(message, "", 0, "data", false, "webcam.frame", 1);
+  {
+    is::recording::Writer writer(directory, 64 << 20);
+    uint64_t arrival = 0;
+    for (auto _ : state) {
+      writer.append(envelope, ++arrival);
+    }
+    writer.flush();
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetItemsProcessed(state.iterations());
+  remove_directory(directory);
+}
+
+// Records arrive every 1000ns, written in two sessions with an empty one between them
+void write_sessions(std::string const& directory, int64_t n) {
+  auto envelope = is::Envelope::Create(is::BasicMessage::Create(std::string(256, 'x')), "", 0,
+                                       "data", false, "robot.pose", 1);
+  for (int64_t session = 0; session < 3; ++session) {
+    is::recording::Writer writer(directory, 4 << 20);
+    if (session == 1)
+      continue;
+    for (int64_t i = session ? n / 2 : 0; i < (session ? n : n / 2); ++i) {
+      writer.append(envelope, 1000 * i);
+    }
+  }
+}
+
+bool seeks_correctly(is::recording::Reader& reader, int64_t n) {
+  is::recording::Record record;
+  for (int64_t i = 0; i < n; i += std::max<int64_t>(n / 64, 1)) {
+    reader.seek(1000 * i - 500 * (i > 0));
+    if (!reader.next(record) || record.arrival != static_cast<uint64_t>(1000 * i))
+      return false;
+  }
+  return true;
+}
+
+void seek(benchmark::State& state) {
+  auto directory = temporary_directory();
+  const int64_t n = state.range(0);
+  write_sessions(directory, n);
+
+  is::recording::Reader reader(directory);
+  if (!seeks_correctly(reader, n)) {
+    state.SkipWithError("seek missed records");
+    remove_directory(directory);
+    return;
+  }
+  is::recording::Record record;
+  uint64_t time = 0;
+  for (auto _ : state) {
+    time = (time + 7919 * 1000) % (1000 * n);
+    reader.seek(time);
+    benchmark::DoNotOptimize(reader.next(record));
+  }
+  remove_directory(directory);
+}
+
+BENCHMARK(append)->Arg(1 << 10)->Arg(64 << 10)->Arg(1 << 20);
+BENCHMARK(seek)->Arg(1000)->Arg(1000000);
+
+BENCHMARK_MAIN();
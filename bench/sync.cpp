@@ -0,0 +1,70 @@
+#include "../include/connection.hpp"
+
+#include <benchmark/benchmark.h>
+#include <random>
+
+/*
+  consume_sync matching logic (is::sync_streams / is::sync_topics) fed from
+  pre-generated envelopes instead of a broker. Every stream produces a frame
+  each 33ms with up to 15ms of jitter and streams start at different frames,
+  so envelopes must be dropped before a synchronized set is found.
+*/
+
+struct Streams {
+  std::vector<std::vector<is::Envelope::ptr_t>> envelopes;
+  std::vector<std::string> topics;
+
+  Streams(size_t n_streams, size_t length) : envelopes(n_streams) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int64_t> jitter(0, 15000000);
+    for (size_t s = 0; s < n_streams; ++s) {
+      topics.push_back("camera." + std::to_string(s) + ".frame");
+      for (size_t i = 0; i < length; ++i) {
+        auto message = is::BasicMessage::Create("");
+        message->Timestamp(i * 33000000 + jitter(gen));
+        envelopes[s].push_back(
+            is::Envelope::Create(message, "", i, "data", false, topics.back(), 1));
+      }
+    }
+  }
+};
+
+void sync_streams(benchmark::State& state) {
+  Streams streams(state.range(0), 4096);
+  std::vector<size_t> positions(streams.envelopes.size());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    positions[i] = i % 4;
+  }
+  for (auto _ : state) {
+    auto synced = is::sync_streams(streams.envelopes.size(),
+                                   [&](size_t i) {
+                                     auto& stream = streams.envelopes[i];
+                                     return stream[positions[i]++ % stream.size()];
+                                   },
+                                   20);
+    benchmark::DoNotOptimize(synced);
+  }
+}
+
+void sync_topics(benchmark::State& state) {
+  Streams streams(state.range(0), 4096);
+  // Interleave all streams as they would arrive in a single queue
+  std::vector<is::Envelope::ptr_t> queue;
+  for (size_t i = 0; i < 4096; ++i) {
+    for (auto&& stream : streams.envelopes) {
+      queue.push_back(stream[i]);
+    }
+  }
+
+  size_t position = 0;
+  for (auto _ : state) {
+    auto synced = is::sync_topics(streams.topics,
+                                  [&]() { return queue[position++ % queue.size()]; }, 20);
+    benchmark::DoNotOptimize(synced);
+  }
+}
+
+BENCHMARK(sync_streams)->RangeMultiplier(2)->Range(2, 32);
+BENCHMARK(sync_topics)->RangeMultiplier(2)->Range(2, 32);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,98 @@
+#include "../include/theora-decoder.hpp"
+#include "../include/theora-encoder.hpp"
+
+#include <benchmark/benchmark.h>
+
+/*
+  TheoraEncoder::encode and TheoraDecoder::decode on synthetic frames. Frames
+  are a moving gradient, so consecutive frames differ as in a real stream.
+*/
+
+std::vector<cv::Mat> make_frames(int width, int height, int n) {
+  std::vector<cv::Mat> frames;
+  for (int i = 0; i < n; ++i) {
+    cv::Mat frame(height, width, CV_8UC3);
+    for (int r = 0; r < height; ++r) {
+      for (int c = 0; c < width; ++c) {
+        frame.at<cv::Vec3b>(r, c) = cv::Vec3b((r + i) % 256, (c + 2 * i) % 256, (r + c) % 256);
+      }
+    }
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+void encode(benchmark::State& state) {
+  auto frames = make_frames(state.range(0), state.range(1), 16);
+  is::TheoraEncoder encoder;
+  encoder.encode(frames[0]);  // headers
+
+  size_t i = 0, bytes = 0;
+  for (auto _ : state) {
+    for (auto&& packet : encoder.encode(frames[i++ % frames.size()])) {
+      bytes += packet.data.size();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["bytes_per_frame"] = static_cast<double>(bytes) / state.iterations();
+}
+
+template <typename Configure>
+void decode_stream(benchmark::State& state, Configure&& configure) {
+  // One keyframe interval (keyframe_granule_shift = 6), so the sequence can be looped
+  auto frames = make_frames(state.range(0), state.range(1), 64);
+  is::TheoraEncoder encoder;
+  std::vector<is::TheoraPacket> packets;
+  for (auto&& frame : frames) {
+    for (auto&& packet : encoder.encode(frame)) {
+      packets.push_back(packet);
+    }
+  }
+
+  is::TheoraDecoder decoder;
+  configure(decoder);
+  decoder.set_headers(encoder.get_headers());
+  auto headers = encoder.get_headers().size();
+
+  size_t i = 0, converted = 0;
+  for (auto _ : state) {
+    auto frame = decoder.decode(packets[headers + i++ % (packets.size() - headers)]);
+    converted += frame ? 1 : 0;
+    benchmark::DoNotOptimize(frame);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["converted"] = static_cast<double>(converted) / state.iterations();
+}
+
+void decode(benchmark::State& state) {
+  decode_stream(state, [](is::TheoraDecoder&) {});
+}
+
+// Analytics modes, cost per received packet
+void decode_keyframes(benchmark::State& state) {
+  decode_stream(state, [](is::TheoraDecoder& decoder) {
+    decoder.mode = is::TheoraDecoder::KEYFRAMES_ONLY;
+  });
+}
+
+void decode_every_8th(benchmark::State& state) {
+  decode_stream(state, [](is::TheoraDecoder& decoder) { decoder.every = 8; });
+}
+
+void decode_half(benchmark::State& state) {
+  decode_stream(state, [](is::TheoraDecoder& decoder) { decoder.scale = 2; });
+}
+
+#define RESOLUTIONS ->Args({320, 240})->Args({640, 480})->Args({1280, 720})->Args({1920, 1080})
+
+BENCHMARK(encode) RESOLUTIONS ->Unit(benchmark::kMillisecond);
+BENCHMARK(decode) RESOLUTIONS ->Unit(benchmark::kMillisecond);
+BENCHMARK(decode_keyframes) RESOLUTIONS ->Unit(benchmark::kMillisecond);
+BENCHMARK(decode_every_8th) RESOLUTIONS ->Unit(benchmark::kMillisecond);
+BENCHMARK(decode_half) RESOLUTIONS ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+  is::logger()->set_level(spdlog::level::warn);
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+}
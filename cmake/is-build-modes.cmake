@@ -0,0 +1,63 @@
+# Opt-in optimization modes for executables using is, call
+# is_build_modes(<target> [TRAIN <command> [args...]]).
+#
+#   IS_ENABLE_LTO=ON        link time optimization (when supported by the toolchain)
+#   IS_PGO=GENERATE         instrument the target, profiles are written to IS_PGO_DIR
+#   IS_PGO=USE              optimize the target with the profiles found in IS_PGO_DIR
+#
+# A profile guided build is done in two passes: build with IS_PGO=GENERATE, run a
+# representative workload of every target, then reconfigure with IS_PGO=USE and
+# rebuild. GCC keeps one profile per object file, so each target has to run its own
+# workload: the TRAIN command (usually the target itself with some arguments) is run
+# by the 'pgo-train-<target>' target, and 'pgo-train' runs all of them. With GCC,
+# targets without profiles are built without PGO and a warning.
+
+include(CheckIPOSupported)
+
+option(IS_ENABLE_LTO "Enable link time optimization" OFF)
+set(IS_PGO "" CACHE STRING "Profile guided optimization pass: GENERATE, USE or empty")
+set_property(CACHE IS_PGO PROPERTY STRINGS "" GENERATE USE)
+set(IS_PGO_DIR "${CMAKE_BINARY_DIR}/pgo" CACHE PATH "Directory holding the PGO profiles")
+
+function(is_build_modes target)
+  cmake_parse_arguments(PARSE_ARGV 1 arg "" "" "TRAIN")
+
+  if(IS_ENABLE_LTO)
+    check_ipo_supported(RESULT supported OUTPUT error LANGUAGES CXX)
+    if(supported)
+      set_property(TARGET ${target} PROPERTY INTERPROCEDURAL_OPTIMIZATION TRUE)
+    else()
+      message(WARNING "LTO is not supported: ${error}")
+    endif()
+  endif()
+
+  if(IS_PGO STREQUAL "GENERATE")
+    target_compile_options(${target} PRIVATE -fprofile-generate=${IS_PGO_DIR})
+    target_link_options(${target} PRIVATE -fprofile-generate=${IS_PGO_DIR})
+    if(arg_TRAIN)
+      if(NOT TARGET pgo-train)
+        add_custom_target(pgo-train COMMENT "Collecting PGO profiles")
+      endif()
+      add_custom_target(pgo-train-${target} ${arg_TRAIN} DEPENDS ${target}
+                        WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+                        COMMENT "Collecting the PGO profile of ${target}")
+      add_dependencies(pgo-train pgo-train-${target})
+    endif()
+  elseif(IS_PGO STREQUAL "USE")
+    if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+      # Profiles are named after the object paths, with '/' replaced by '#'
+      string(REPLACE "/" "#" objects "${CMAKE_CURRENT_BINARY_DIR}/CMakeFiles/${target}.dir/")
+      file(GLOB profiles "${IS_PGO_DIR}/${objects}*.gcda")
+      if(NOT profiles)
+        message(WARNING "No PGO profile of ${target} in ${IS_PGO_DIR}, building it without PGO")
+        return()
+      endif()
+      target_compile_options(${target} PRIVATE -fprofile-use=${IS_PGO_DIR} -fprofile-correction)
+    else()
+      target_compile_options(${target} PRIVATE -fprofile-use=${IS_PGO_DIR})
+    endif()
+    target_link_options(${target} PRIVATE -fprofile-use=${IS_PGO_DIR})
+  elseif(NOT IS_PGO STREQUAL "")
+    message(FATAL_ERROR "Invalid IS_PGO value \"${IS_PGO}\", use GENERATE, USE or empty")
+  endif()
+endfunction()
@@ -0,0 +1,127 @@
+#ifndef __IS_ACK_BATCHER_HPP__
+#define __IS_ACK_BATCHER_HPP__
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+namespace is {
+
+using namespace AmqpClient;
+using namespace std::chrono;
+
+/*
+  Coalesces acknowledgements into a single multiple-ack every 'max_messages'
+  messages or once the oldest pending one waited 'max_delay'. A multiple-ack
+  also covers every earlier delivery of the consumer, so messages must be
+  acked in delivery order and all of them must come from a single consumer,
+  see AckBatchers for several. With the defaults every message is acked
+  immediately.
+*/
+class AckBatcher {
+  Channel::ptr_t channel;
+  size_t max_messages;
+  milliseconds max_delay;
+
+  Envelope::ptr_t last;
+  size_t n_pending;
+  steady_clock::time_point oldest;
+
+ public:
+  AckBatcher(Channel::ptr_t const& channel, size_t max_messages = 1,
+             milliseconds max_delay = milliseconds(0))
+      : channel(channel),
+        max_messages(std::max<size_t>(max_messages, 1)),
+        max_delay(max_delay),
+        n_pending(0) {}
+
+  size_t batch_size() const { return max_messages; }
+  size_t pending() const { return n_pending; }
+
+  void ack(Envelope::ptr_t const& envelope) {
+    if (n_pending++ == 0) {
+      oldest = steady_clock::now();
+    }
+    last = envelope;
+    if (n_pending >= max_messages || steady_clock::now() - oldest >= max_delay) {
+      flush();
+    }
+  }
+
+  void flush() {
+    if (n_pending == 0)
+      return;
+    channel->BasicAck(last->GetDeliveryInfo(), n_pending > 1);
+    last = nullptr;
+    n_pending = 0;
+  }
+
+  // How long a consumer may block before the pending acks are due, -1 if none
+  int timeout_ms() const {
+    if (n_pending == 0)
+      return -1;
+    auto left = duration_cast<milliseconds>(oldest + max_delay - steady_clock::now()).count();
+    return static_cast<int>(std::max<int64_t>(left, 0));
+  }
+};  // ::AckBatcher
+
+/*
+  One AckBatcher per consumer tag. SimpleAmqpClient opens an AMQP channel for
+  each consumer and delivery tags are per channel, so a multiple-ack sent for
+  the last envelope only covers the deliveries of that same consumer.
+*/
+class AckBatchers {
+  Channel::ptr_t channel;
+  size_t max_messages;
+  milliseconds max_delay;
+  std::unordered_map<std::string, AckBatcher> batchers;  // consumer tag -> batcher
+
+ public:
+  AckBatchers(Channel::ptr_t const& channel, size_t max_messages = 1,
+              milliseconds max_delay = milliseconds(0))
+      : channel(channel), max_messages(std::max<size_t>(max_messages, 1)), max_delay(max_delay) {}
+
+  size_t batch_size() const { return max_messages; }
+
+  size_t pending() const {
+    size_t n = 0;
+    for (auto&& batcher : batchers) {
+      n += batcher.second.pending();
+    }
+    return n;
+  }
+
+  void ack(Envelope::ptr_t const& envelope) {
+    auto batcher = batchers.find(envelope->ConsumerTag());
+    if (batcher == batchers.end()) {
+      batcher = batchers
+                    .emplace(envelope->ConsumerTag(), AckBatcher(channel, max_messages, max_delay))
+                    .first;
+    }
+    batcher->second.ack(envelope);
+  }
+
+  void flush() {
+    for (auto&& batcher : batchers) {
+      batcher.second.flush();
+    }
+  }
+
+  // Earliest time any consumer's pending acks are due, -1 if none
+  int timeout_ms() const {
+    int timeout = -1;
+    for (auto&& batcher : batchers) {
+      auto due = batcher.second.timeout_ms();
+      if (due >= 0 && (timeout < 0 || due < timeout)) {
+        timeout = due;
+      }
+    }
+    return timeout;
+  }
+};  // ::AckBatchers
+
+}  // ::is
+
+#endif  // __IS_ACK_BATCHER_HPP__
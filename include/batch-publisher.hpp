@@ -0,0 +1,84 @@
+#ifndef __IS_BATCH_PUBLISHER_HPP__
+#define __IS_BATCH_PUBLISHER_HPP__
+
+#include <chrono>
+#include <string>
+#include "connection.hpp"
+#include "logger.hpp"
+#include "msgs/batch.hpp"
+#include "packer.hpp"
+
+namespace is {
+
+/*
+  Accumulates samples of a high rate stream and publishes them as a single
+  msg::common::Batch<T> once 'max_samples' were added or the first one waited
+  'max_delay'. The delay is only checked when samples are added (or on
+  flush_if_due), so a stalled stream should be flushed explicitly. Subscribers
+  decode is::msgpack<Batch<T>> and iterate over the samples.
+*/
+template <typename T>
+class BatchPublisher {
+  Connection is;
+  const std::string topic;
+  const std::string exchange;
+  const size_t max_samples;
+  const nanoseconds max_delay;
+
+  msg::common::Batch<T> batch;
+  steady_clock::time_point opened;  // When the first sample of the batch was added
+
+ public:
+  BatchPublisher(Connection connection, std::string const& topic, size_t max_samples = 100,
+                 milliseconds max_delay = milliseconds(50), std::string const& exchange = "data")
+      : is(connection),
+        topic(topic),
+        exchange(exchange),
+        max_samples(max_samples),
+        max_delay(max_delay) {
+    batch.reserve(max_samples);
+  }
+
+  ~BatchPublisher() {
+    try {
+      flush();
+    } catch (std::exception const& e) {
+      log::warn("Failed to publish the last batch of \"{}\": {}", topic, e.what());
+    }
+  }
+
+  // Returns true if the batch was published
+  bool add(T const& sample,
+           uint64_t timestamp = system_clock::now().time_since_epoch().count()) {
+    if (batch.empty()) {
+      opened = steady_clock::now();
+    }
+    batch.push_back(sample, timestamp);
+    if (batch.size() >= max_samples) {
+      return flush();
+    }
+    return flush_if_due();
+  }
+
+  // The batch age is measured on the steady clock, wall clock steps neither hold nor rush it
+  bool flush_if_due() {
+    if (batch.empty() || steady_clock::now() - opened < max_delay) {
+      return false;
+    }
+    return flush();
+  }
+
+  bool flush() {
+    if (batch.empty())
+      return false;
+    auto message = is::msgpack(batch);
+    message->Timestamp(batch.start);
+    is.publish(topic, message, exchange);
+    batch.clear();
+    return true;
+  }
+};  // ::BatchPublisher
+
+}  // ::is
+
+#endif  // __IS_BATCH_PUBLISHER_HPP__
@@ -0,0 +1,232 @@
+#ifndef __IS_BOUNDED_RING_HPP__
+#define __IS_BOUNDED_RING_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace is {
+
+/*
+  Bounded lock-free queue (Vyukov's array queue: every cell carries a sequence
+  number telling whether it is ready to be written or read). Meant to connect
+  one producer and one consumer thread, but pops are also safe from the
+  producer, which is what push_overwrite uses to drop the oldest element
+  instead of blocking when the consumer falls behind.
+*/
+template <typename T>
+class BoundedRing {
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  const size_t mask;
+  std::unique_ptr<Cell[]> cells;
+  // Keeps producer and consumer positions on separate cache lines (alignas
+  // would need C++17 aligned new for heap allocated rings)
+  struct Position {
+    std::atomic<size_t> value{0};
+    char padding[64 - sizeof(std::atomic<size_t>)];
+  };
+
+  Position head;  // Next position to write
+  Position tail;  // Next position to read
+  std::atomic<uint64_t> drops{0};
+
+  static size_t round_up(size_t n) {
+    size_t capacity = 2;
+    while (capacity < n) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+ public:
+  // Capacity is rounded up to a power of two (at least 2)
+  explicit BoundedRing(size_t capacity) : mask(round_up(capacity) - 1), cells(new Cell[mask + 1]) {
+    for (size_t i = 0; i <= mask; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedRing(BoundedRing const&) = delete;
+  BoundedRing& operator=(BoundedRing const&) = delete;
+
+  size_t capacity() const { return mask + 1; }
+
+  // Elements discarded by push_overwrite
+  uint64_t dropped() const { return drops.load(std::memory_order_relaxed); }
+
+  // Approximate when called concurrently with push/pop
+  size_t size() const {
+    return head.value.load(std::memory_order_relaxed) - tail.value.load(std::memory_order_relaxed);
+  }
+
+  // Moves from 'value' only on success, returns false if the ring is full
+  bool try_push(T& value) {
+    auto position = head.value.load(std::memory_order_relaxed);
+    for (;;) {
+      auto&& cell = cells[position & mask];
+      auto sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(sequence - position);
+      if (diff == 0) {
+        if (head.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = head.value.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pop(T& value) {
+    auto position = tail.value.load(std::memory_order_relaxed);
+    for (;;) {
+      auto&& cell = cells[position & mask];
+      auto sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+      if (diff == 0) {
+        if (tail.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          value = std::move(cell.value);
+          cell.sequence.store(position + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = tail.value.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Never blocks, drops the oldest elements until there is room. Returns how many were dropped
+  size_t push_overwrite(T value) {
+    size_t dropped = 0;
+    while (!try_push(value)) {
+      T oldest;
+      if (try_pop(oldest)) {
+        ++dropped;
+      }
+    }
+    if (dropped) {
+      drops.fetch_add(dropped, std::memory_order_relaxed);
+    }
+    return dropped;
+  }
+};  // ::BoundedRing
+
+/*
+  Lets threads sleep until a lock-free structure has something for them,
+  without making the other side lock when nobody sleeps: sleepers count
+  themselves before checking their condition, and ring() only locks and
+  notifies if someone is counted. Any number of threads on either side.
+*/
+class Doorbell {
+  std::mutex mutex;
+  std::condition_variable bell;
+  std::atomic<int> waiting{0};
+
+ public:
+  // After making progress, wakes one sleeper or, with 'all', every one
+  void ring(bool all = false) {
+    // Pairs with the fence of wait_for: either the sleeper sees the progress or we see it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (all) {
+        bell.notify_all();
+      } else {
+        bell.notify_one();
+      }
+    }
+  }
+
+  // Sleeps until ready() or the timeout, returns ready()
+  template <typename Time, typename Ready>
+  bool wait_for(Time const& timeout, Ready&& ready) {
+    std::unique_lock<std::mutex> lock(mutex);
+    waiting.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto result = bell.wait_for(lock, timeout, ready);
+    waiting.fetch_sub(1, std::memory_order_relaxed);
+    return result;
+  }
+};  // ::Doorbell
+
+/*
+  BoundedRing whose consumers can sleep while it is empty and producers while
+  it is full. Pops wake a producer and pushes a consumer, ring() wakes them
+  all, e.g. to notice the 'done' condition of a wait (a closed stream).
+*/
+template <typename T>
+class BlockingRing {
+  BoundedRing<T> elements;
+  Doorbell readable;  // Consumers waiting for elements
+  Doorbell writable;  // Producers waiting for room
+
+  static bool never() { return false; }
+
+ public:
+  explicit BlockingRing(size_t capacity) : elements(capacity) {}
+
+  size_t capacity() const { return elements.capacity(); }
+  uint64_t dropped() const { return elements.dropped(); }
+  size_t size() const { return elements.size(); }
+
+  bool try_push(T& value) {
+    if (!elements.try_push(value))
+      return false;
+    readable.ring();
+    return true;
+  }
+
+  // Never blocks, see BoundedRing::push_overwrite
+  size_t push_overwrite(T value) {
+    auto dropped = elements.push_overwrite(std::move(value));
+    readable.ring();
+    return dropped;
+  }
+
+  bool try_pop(T& value) {
+    if (!elements.try_pop(value))
+      return false;
+    writable.ring();
+    return true;
+  }
+
+  // Waits at most 'timeout' for room, or until done() holds after a ring()
+  template <typename Time, typename Done = bool (*)()>
+  bool push_for(T& value, Time const& timeout, Done&& done = never) {
+    if (try_push(value))
+      return true;
+    writable.wait_for(timeout, [&]() { return size() < capacity() || done(); });
+    return try_push(value);
+  }
+
+  // Waits at most 'timeout' for an element, or until done() holds after a ring()
+  template <typename Time, typename Done = bool (*)()>
+  bool pop_for(T& value, Time const& timeout, Done&& done = never) {
+    if (try_pop(value))
+      return true;
+    readable.wait_for(timeout, [&]() { return size() > 0 || done(); });
+    return try_pop(value);
+  }
+
+  void ring() {
+    readable.ring(true);
+    writable.ring(true);
+  }
+};  // ::BlockingRing
+
+}  // ::is
+
+#endif  // __IS_BOUNDED_RING_HPP__
@@ -0,0 +1,212 @@
+#ifndef __IS_CAMERA_PIPELINE_HPP__
+#define __IS_CAMERA_PIPELINE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include "bounded-ring.hpp"
+#include "connection.hpp"
+#include "executor.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "packer.hpp"
+#include "theora-encoder.hpp"
+
+namespace is {
+
+/*
+  Camera node split in capture, encode and publish threads connected by
+  bounded lock-free rings, so grabbing keeps the sensor rate when encoding or
+  the broker stall. Frames are timestamped as soon as they are grabbed. When
+  the encoder falls behind the oldest raw frames are dropped; encoded packets
+  are never dropped (Theora frames depend on the previous ones), the encoder
+  waits for the publisher instead and the backlog ends up as raw frame drops.
+
+    CameraPipeline pipeline(is::connect(uri), "webcam.frame",
+                            [&](cv::Mat& frame) { return webcam.read(frame); });
+    pipeline.start();
+    pipeline.wait();  // Until capture returns false
+*/
+class CameraPipeline {
+ public:
+  // Grabs the next frame, false ends the stream
+  using Capture = std::function<bool(cv::Mat&)>;
+
+  struct Stage {
+    std::atomic<uint64_t> frames{0};   // Processed (packets for the publish stage)
+    std::atomic<uint64_t> dropped{0};  // Discarded waiting for this stage
+    metrics::LatencyHistogram busy;     // Time spent in the stage [ns]
+    metrics::LatencyHistogram latency;  // Frame timestamp to the end of the stage [ns]
+  };
+
+  struct Stats {
+    Stage capture;  // Latency is the time spent grabbing
+    Stage encode;
+    Stage publish;
+  };
+
+  TheoraEncoder encoder;  // Only get_headers may be called while running
+  Stats stats;
+
+  CameraPipeline(Connection connection, std::string const& topic, Capture capture,
+                 size_t depth = 4, std::string const& exchange = "data")
+      : is(connection),
+        topic(topic),
+        exchange(exchange),
+        capture(std::move(capture)),
+        frames(depth),
+        packets(depth) {}
+
+  ~CameraPipeline() { stop(); }
+
+  CameraPipeline(CameraPipeline const&) = delete;
+  CameraPipeline& operator=(CameraPipeline const&) = delete;
+
+  // Called from the encode thread when the stream headers change, set before start()
+  void on_new_header(std::function<void()> callback) { new_header = std::move(callback); }
+
+  // Threads come from the "capture", "encode" and "network" pools of the executor
+  void start(Executor& executor = is::executor()) {
+    running = capturing = encoding = true;
+    threads[0] = executor.spawn("capture", [this]() { capture_loop(); });
+    threads[1] = executor.spawn("encode", [this]() { encode_loop(); });
+    threads[2] = executor.spawn("network", [this]() { publish_loop(); });
+  }
+
+  // Waits for the end of the stream, everything captured until then is published
+  void wait() {
+    for (auto&& thread : threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  }
+
+  // Stops all stages, frames still queued are discarded
+  void stop() {
+    running = false;
+    wait();
+  }
+
+ private:
+  struct Frame {
+    cv::Mat image;
+    uint64_t timestamp;  // [ns since epoch]
+    steady_clock::time_point captured;
+  };
+
+  struct Packet {
+    BasicMessage::ptr_t message;
+    steady_clock::time_point captured;
+  };
+
+  Connection is;  // Publish thread only
+  const std::string topic;
+  const std::string exchange;
+  Capture capture;
+  std::function<void()> new_header;
+
+  BoundedRing<Frame> frames;
+  BoundedRing<Packet> packets;
+
+  std::atomic<bool> running{false};
+  std::atomic<bool> capturing{false};  // Cleared after the last frame was queued
+  std::atomic<bool> encoding{false};   // Cleared after the last packet was queued
+  std::thread threads[3];
+
+  static uint64_t since(steady_clock::time_point start) {
+    return duration_cast<nanoseconds>(steady_clock::now() - start).count();
+  }
+
+  // Spins briefly, then sleeps, so idle stages do not keep a core busy
+  static void idle(unsigned& attempts) {
+    if (++attempts < 64) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(microseconds(100));
+    }
+  }
+
+  // False once stopped, or when the upstream stage finished and the ring is empty
+  template <typename T>
+  bool pop(BoundedRing<T>& ring, T& value, std::atomic<bool> const& upstream) {
+    for (unsigned attempts = 0;; idle(attempts)) {
+      if (ring.try_pop(value))
+        return true;
+      if (!running)
+        return false;
+      if (!upstream)
+        return ring.try_pop(value);
+    }
+  }
+
+  void capture_loop() {
+    try {
+      while (running) {
+        Frame frame;
+        auto start = steady_clock::now();
+        if (!capture(frame.image))
+          break;
+        frame.captured = steady_clock::now();
+        frame.timestamp = system_clock::now().time_since_epoch().count();
+
+        auto elapsed = since(start);
+        stats.capture.busy.record(elapsed);
+        stats.capture.latency.record(elapsed);
+        stats.capture.frames.fetch_add(1, std::memory_order_relaxed);
+        auto dropped = frames.push_overwrite(std::move(frame));
+        stats.encode.dropped.fetch_add(dropped, std::memory_order_relaxed);
+      }
+    } catch (std::exception const& e) {
+      log::error("Camera capture stopped \n\t@reason: \"{}\"", e.what());
+    }
+    capturing = false;
+  }
+
+  void encode_loop() {
+    try {
+      Frame frame;
+      while (pop(frames, frame, capturing)) {
+        auto start = steady_clock::now();
+        for (auto&& encoded : encoder.encode(frame.image)) {
+          if (encoded.new_header && new_header) {
+            new_header();
+          }
+          Packet packet{is::msgpack(encoded), frame.captured};
+          packet.message->Timestamp(frame.timestamp);
+          for (unsigned attempts = 0; !packets.try_push(packet) && running; idle(attempts)) {
+          }
+        }
+        stats.encode.busy.record(since(start));
+        stats.encode.latency.record(since(frame.captured));
+        stats.encode.frames.fetch_add(1, std::memory_order_relaxed);
+      }
+    } catch (std::exception const& e) {
+      log::error("Camera encoder stopped \n\t@reason: \"{}\"", e.what());
+      running = false;
+    }
+    encoding = false;
+  }
+
+  void publish_loop() {
+    try {
+      Packet packet;
+      while (pop(packets, packet, encoding)) {
+        auto start = steady_clock::now();
+        is.publish(topic, packet.message, exchange);
+        stats.publish.busy.record(since(start));
+        stats.publish.latency.record(since(packet.captured));
+        stats.publish.frames.fetch_add(1, std::memory_order_relaxed);
+      }
+    } catch (std::exception const& e) {
+      log::error("Camera publisher stopped \n\t@reason: \"{}\"", e.what());
+      running = false;
+    }
+  }
+};  // ::CameraPipeline
+
+}  // ::is
+
+#endif  // __IS_CAMERA_PIPELINE_HPP__
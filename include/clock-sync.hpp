@@ -0,0 +1,261 @@
+#ifndef __IS_CLOCK_SYNC_HPP__
+#define __IS_CLOCK_SYNC_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "executor.hpp"
+#include "helpers.hpp"
+#include "logger.hpp"
+#include "msgs/common.hpp"
+#include "packer.hpp"
+#include "service-client.hpp"
+#include "service-provider.hpp"
+
+namespace is {
+
+/*
+  Offset and drift of a peer clock from NTP style exchanges. Each round keeps
+  only its exchange with the lowest round trip (the least affected by queueing),
+  and a line fitted through the last 'window' rounds gives the drift, so the
+  offset can be extrapolated between rounds.
+*/
+class ClockFilter {
+ public:
+  struct Estimate {
+    int64_t offset = 0;     // Peer clock minus local clock at 'reference' [ns]
+    double drift = 0.0;     // Offset change per local nanosecond (1e-6 is 1 ppm)
+    int64_t delay = 0;      // Round trip of the last round's best exchange [ns]
+    int64_t reference = 0;  // Local time of the estimate [ns since epoch]
+    size_t rounds = 0;
+
+    // Offset extrapolated to the local time 'now' [ns since epoch]
+    int64_t offset_at(int64_t now) const {
+      return offset + static_cast<int64_t>(drift * (now - reference));
+    }
+  };
+
+  explicit ClockFilter(size_t window = 32) : window(window) {}
+
+  // t0 request sent, t1 request received by the peer, t2 reply sent, t3 reply received
+  void add(int64_t t0, int64_t t1, int64_t t2, int64_t t3) {
+    Point point{t3, ((t1 - t0) + (t2 - t3)) / 2, (t3 - t0) - (t2 - t1)};
+    if (!has_best || point.delay < best.delay) {
+      best = point;
+      has_best = true;
+    }
+  }
+
+  // Ends the current round, returns false if it had no exchanges
+  bool commit() {
+    if (!has_best)
+      return false;
+    has_best = false;
+    points.push_back(best);
+    while (points.size() > window) {
+      points.pop_front();
+    }
+    fit();
+    return true;
+  }
+
+  Estimate const& estimate() const { return current; }
+
+ private:
+  struct Point {
+    int64_t time;
+    int64_t offset;
+    int64_t delay;
+  };
+
+  const size_t window;
+  std::deque<Point> points;
+  Point best{0, 0, 0};
+  bool has_best = false;
+  Estimate current;
+
+  // Least squares line through the points, relative to the last one to keep precision
+  void fit() {
+    auto&& last = points.back();
+    double n = points.size(), mean_x = 0.0, mean_y = 0.0;
+    for (auto&& point : points) {
+      mean_x += (point.time - last.time) / n;
+      mean_y += (point.offset - last.offset) / n;
+    }
+    double sxx = 0.0, sxy = 0.0;
+    for (auto&& point : points) {
+      auto dx = (point.time - last.time) - mean_x;
+      sxx += dx * dx;
+      sxy += dx * ((point.offset - last.offset) - mean_y);
+    }
+    current.drift = sxx > 0.0 ? sxy / sxx : 0.0;
+    current.offset = last.offset + static_cast<int64_t>(mean_y - current.drift * mean_x);
+    current.delay = last.delay;
+    current.reference = last.time;
+    current.rounds = points.size();
+  }
+};  // ::ClockFilter
+
+// Answers clock exchanges, expose it on every node whose timestamps need correcting
+inline Reply clock_service(Request request) {
+  auto received = system_clock::now().time_since_epoch().count();
+  auto exchange = msgpack<msg::common::ClockExchange>(request);
+  exchange.request_received = received;
+  exchange.reply_sent = system_clock::now().time_since_epoch().count();
+  return msgpack(exchange);
+}
+
+// Works with ServiceProvider, FiberServiceProvider or anything with expose(binding, service)
+template <typename Provider>
+void expose_clock(Provider& provider) {
+  provider.expose("sync_clock", clock_service);
+}
+
+/*
+  Keeps offset and drift estimates of the clocks of the given peers (service
+  provider names exposing expose_clock) to correct latencies computed from
+  message timestamps across hosts. Messages are attributed to the peer whose
+  name prefixes their topic, e.g. "camera.0" for "camera.0.frame". Either call
+  sync() periodically or start() a thread doing it every 'period'.
+*/
+class ClockSync {
+  ServiceClient client;
+  const std::vector<std::string> names;
+  const milliseconds period;
+  const int exchanges;
+
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, ClockFilter> filters;  // Guarded by the mutex
+
+  std::atomic<bool> running{false};
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  std::thread thread;
+
+ public:
+  ClockSync(std::string const& uri, std::vector<std::string> const& peers,
+            milliseconds period = seconds(1), int exchanges = 4)
+      : ClockSync(make_channel(uri), peers, period, exchanges) {}
+
+  // The channel is only used by the syncing thread
+  ClockSync(Channel::ptr_t const& channel, std::vector<std::string> const& peers,
+            milliseconds period = seconds(1), int exchanges = 4)
+      : client(channel), names(peers), period(period), exchanges(exchanges) {
+    for (auto&& peer : peers) {
+      filters.emplace(peer, ClockFilter());
+    }
+  }
+
+  ~ClockSync() { stop(); }
+
+  ClockSync(ClockSync const&) = delete;
+  ClockSync& operator=(ClockSync const&) = delete;
+
+  // One round of 'exchanges' sequential exchanges with every peer
+  void sync(milliseconds timeout = milliseconds(200)) {
+    for (auto&& peer : names) {
+      std::vector<int64_t> samples;
+      for (int i = 0; i < exchanges; ++i) {
+        msg::common::ClockExchange exchange;
+        exchange.request_sent = system_clock::now().time_since_epoch().count();
+        auto deadline = system_clock::now() + timeout;
+        auto id = client.request(peer + ".sync_clock", msgpack(exchange), deadline);
+        auto reply = client.receive_until(deadline, id, policy::discard_others);
+        auto received = system_clock::now().time_since_epoch().count();
+        if (reply == nullptr)
+          continue;
+        exchange = msgpack<msg::common::ClockExchange>(reply);
+        samples.insert(samples.end(), {exchange.request_sent, exchange.request_received,
+                                       exchange.reply_sent, received});
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      auto&& filter = filters.at(peer);
+      for (size_t i = 0; i < samples.size(); i += 4) {
+        filter.add(samples[i], samples[i + 1], samples[i + 2], samples[i + 3]);
+      }
+      if (!filter.commit()) {
+        log::warn("No clock exchange with \"{}\" completed", peer);
+      }
+    }
+  }
+
+  // The syncing thread comes from the "background" pool of the executor
+  void start(Executor& executor = is::executor()) {
+    if (running.exchange(true))
+      return;
+    thread = executor.spawn("background", [this]() {
+      while (running) {
+        try {
+          sync();
+        } catch (std::exception const& e) {
+          log::warn("Clock sync failed \n\t@reason: \"{}\"", e.what());
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait_for(lock, period, [this]() { return !running; });
+      }
+    });
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      running = false;
+    }
+    wake.notify_all();
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  // Returns false for unknown peers and peers never reached
+  bool estimate(std::string const& peer, ClockFilter::Estimate& estimate) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto filter = filters.find(peer);
+    if (filter == filters.end() || filter->second.estimate().rounds == 0)
+      return false;
+    estimate = filter->second.estimate();
+    return true;
+  }
+
+  // Longest peer name prefixing the topic, empty if none
+  std::string peer_of(std::string const& topic) const {
+    std::string peer;
+    for (auto&& name : names) {
+      if (name.size() > peer.size() && topic.size() > name.size() &&
+          topic.compare(0, name.size(), name) == 0 && topic[name.size()] == '.') {
+        peer = name;
+      }
+    }
+    return peer;
+  }
+
+  // Clock offset (publisher minus local) of messages on the topic, 0 for unknown peers [ns]
+  int64_t offset_of(std::string const& topic,
+                    int64_t now = system_clock::now().time_since_epoch().count()) const {
+    ClockFilter::Estimate estimate;
+    return this->estimate(peer_of(topic), estimate) ? estimate.offset_at(now) : 0;
+  }
+
+  // Time since the envelope was published, in the local clock [ns]
+  int64_t latency(Envelope::ptr_t const& envelope,
+                  int64_t now = system_clock::now().time_since_epoch().count()) const {
+    auto timestamp = static_cast<int64_t>(envelope->Message()->Timestamp());
+    return now - timestamp + offset_of(envelope->RoutingKey(), now);
+  }
+};  // ::ClockSync
+
+// Same as latency(envelope) [ms], corrected by the publisher clock offset
+inline auto latency(Envelope::ptr_t envelope, ClockSync const& clocks) {
+  return duration_cast<milliseconds>(nanoseconds(clocks.latency(envelope))).count();
+}
+
+}  // ::is
+
+#endif  // __IS_CLOCK_SYNC_HPP__
@@ -0,0 +1,408 @@
+#ifndef __IS_CODEC_HPP__
+#define __IS_CODEC_HPP__
+
+#ifndef MSGPACK_USE_BOOST
+#define MSGPACK_USE_BOOST
+#endif
+
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <msgpack.hpp>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*
+  Direct msgpack codec for IS_DEFINE_MSG structs.
+
+  Decoding walks the raw buffer once and writes straight into the destination
+  fields, instead of building a msgpack::object tree in a zone and converting
+  it afterwards. Encoding uses the msgpack packer on a string buffer, so the
+  wire format is exactly the one produced by MSGPACK_DEFINE_ARRAY. Types the
+  codec does not know (custom adaptors such as cv::Mat) fall back to the
+  regular msgpack::object path for that element only.
+*/
+
+namespace is {
+namespace codec {
+
+// Stream adaptor for msgpack::packer that appends to a std::string
+struct StringBuffer {
+  std::string& str;
+  void write(const char* data, size_t size) { str.append(data, size); }
+};
+
+template <typename T>
+std::string encode(T const& data) {
+  std::string str;
+  StringBuffer buffer{str};
+  msgpack::pack(buffer, data);
+  return str;
+}
+
+class Reader {
+  const char* pos;
+  const char* end;
+
+  void require(size_t size) const {
+    if (static_cast<size_t>(end - pos) < size)
+      throw msgpack::insufficient_bytes("insufficient bytes");
+  }
+
+  uint64_t big_endian(size_t size) {
+    require(size);
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+      value = (value << 8) | static_cast<uint8_t>(pos[i]);
+    }
+    pos += size;
+    return value;
+  }
+
+  uint8_t next() {
+    require(1);
+    return static_cast<uint8_t>(*pos++);
+  }
+
+  // Every element takes at least a byte, so a length off the wire can't ask for more
+  uint32_t elements(uint64_t n, uint64_t bytes_each) const {
+    if (n * bytes_each > static_cast<size_t>(end - pos))
+      throw msgpack::type_error();
+    return static_cast<uint32_t>(n);
+  }
+
+ public:
+  Reader(const char* data, size_t size) : pos(data), end(data + size) {}
+
+  const char* position() const { return pos; }
+
+  uint8_t peek() const {
+    require(1);
+    return static_cast<uint8_t>(*pos);
+  }
+
+  bool read_nil() {
+    if (peek() != 0xc0)
+      return false;
+    ++pos;
+    return true;
+  }
+
+  bool read_bool() {
+    switch (next()) {
+      case 0xc2: return false;
+      case 0xc3: return true;
+      default: throw msgpack::type_error();
+    }
+  }
+
+  // Number of elements, throws if the buffer is too short to hold them
+  uint32_t read_array() {
+    auto tag = next();
+    if ((tag & 0xf0) == 0x90)
+      return elements(tag & 0x0f, 1);
+    if (tag == 0xdc)
+      return elements(big_endian(2), 1);
+    if (tag == 0xdd)
+      return elements(big_endian(4), 1);
+    throw msgpack::type_error();
+  }
+
+  // Number of key value pairs, throws if the buffer is too short to hold them
+  uint32_t read_map() {
+    auto tag = next();
+    if ((tag & 0xf0) == 0x80)
+      return elements(tag & 0x0f, 2);
+    if (tag == 0xde)
+      return elements(big_endian(2), 2);
+    if (tag == 0xdf)
+      return elements(big_endian(4), 2);
+    throw msgpack::type_error();
+  }
+
+  // Reads any integer, returning true if it is negative (stored in 'negative')
+  bool read_integer(uint64_t& positive, int64_t& negative) {
+    auto tag = next();
+    if (tag <= 0x7f) {
+      positive = tag;
+      return false;
+    }
+    if (tag >= 0xe0) {
+      negative = static_cast<int8_t>(tag);
+      return true;
+    }
+    switch (tag) {
+      case 0xcc: positive = big_endian(1); return false;
+      case 0xcd: positive = big_endian(2); return false;
+      case 0xce: positive = big_endian(4); return false;
+      case 0xcf: positive = big_endian(8); return false;
+      case 0xd0: negative = static_cast<int8_t>(big_endian(1)); break;
+      case 0xd1: negative = static_cast<int16_t>(big_endian(2)); break;
+      case 0xd2: negative = static_cast<int32_t>(big_endian(4)); break;
+      case 0xd3: negative = static_cast<int64_t>(big_endian(8)); break;
+      default: throw msgpack::type_error();
+    }
+    // msgpack-c classifies signed encodings of non negative values as positive
+    if (negative >= 0) {
+      positive = negative;
+      return false;
+    }
+    return true;
+  }
+
+  double read_float() {
+    auto tag = peek();
+    if (tag == 0xca) {
+      ++pos;
+      uint32_t bits = big_endian(4);
+      float value;
+      std::memcpy(&value, &bits, sizeof value);
+      return value;
+    }
+    if (tag == 0xcb) {
+      ++pos;
+      uint64_t bits = big_endian(8);
+      double value;
+      std::memcpy(&value, &bits, sizeof value);
+      return value;
+    }
+    uint64_t positive;
+    int64_t negative;
+    return read_integer(positive, negative) ? static_cast<double>(negative)
+                                            : static_cast<double>(positive);
+  }
+
+  // Reads a str or bin header, returning a view over its payload
+  uint32_t read_raw(const char*& data) {
+    auto tag = next();
+    uint32_t size;
+    if ((tag & 0xe0) == 0xa0) {
+      size = tag & 0x1f;
+    } else {
+      switch (tag) {
+        case 0xc4:
+        case 0xd9: size = big_endian(1); break;
+        case 0xc5:
+        case 0xda: size = big_endian(2); break;
+        case 0xc6:
+        case 0xdb: size = big_endian(4); break;
+        default: throw msgpack::type_error();
+      }
+    }
+    require(size);
+    data = pos;
+    pos += size;
+    return size;
+  }
+
+  void skip() {
+    auto tag = next();
+    if (tag <= 0x7f || tag >= 0xe0 || tag == 0xc0 || tag == 0xc2 || tag == 0xc3)
+      return;
+    if ((tag & 0xe0) == 0xa0)
+      return advance(tag & 0x1f);
+    if ((tag & 0xf0) == 0x90)
+      return skip_n(tag & 0x0f);
+    if ((tag & 0xf0) == 0x80)
+      return skip_n(2 * (tag & 0x0f));
+
+    switch (tag) {
+      case 0xcc:
+      case 0xd0: return advance(1);
+      case 0xcd:
+      case 0xd1: return advance(2);
+      case 0xca:
+      case 0xce:
+      case 0xd2: return advance(4);
+      case 0xcb:
+      case 0xcf:
+      case 0xd3: return advance(8);
+      case 0xc4:
+      case 0xd9: return advance(big_endian(1));
+      case 0xc5:
+      case 0xda: return advance(big_endian(2));
+      case 0xc6:
+      case 0xdb: return advance(big_endian(4));
+      case 0xc7: { auto size = big_endian(1); return advance(size + 1); }
+      case 0xc8: { auto size = big_endian(2); return advance(size + 1); }
+      case 0xc9: { auto size = big_endian(4); return advance(size + 1); }
+      case 0xd4: return advance(2);
+      case 0xd5: return advance(3);
+      case 0xd6: return advance(5);
+      case 0xd7: return advance(9);
+      case 0xd8: return advance(17);
+      case 0xdc: return skip_n(big_endian(2));
+      case 0xdd: return skip_n(big_endian(4));
+      case 0xde: return skip_n(2 * big_endian(2));
+      case 0xdf: return skip_n(2 * big_endian(4));
+      default: throw msgpack::unpack_error("parse error");
+    }
+  }
+
+ private:
+  void advance(uint64_t size) {
+    require(size);
+    pos += size;
+  }
+
+  void skip_n(uint64_t n) {
+    while (n--) skip();
+  }
+};
+
+struct any_visitor {
+  template <typename... Ts>
+  void operator()(Ts&&...) const {}
+};
+
+// True for types declared with IS_DEFINE_MSG
+template <typename T, typename = void>
+struct is_reflected : std::false_type {};
+
+template <typename T>
+struct is_reflected<T, decltype(std::declval<T&>().is_reflect(any_visitor{}))> : std::true_type {};
+
+template <typename T, typename Enable = void>
+struct Decoder {
+  // Unknown type: isolate the element and let its msgpack adaptor convert it
+  void operator()(Reader& reader, T& value) const {
+    auto begin = reader.position();
+    reader.skip();
+    msgpack::object_handle handle = msgpack::unpack(begin, reader.position() - begin);
+    handle.get().convert(value);
+  }
+};
+
+template <typename T>
+void decode(Reader& reader, T& value) {
+  Decoder<T>()(reader, value);
+}
+
+template <typename T>
+T decode(const char* data, size_t size) {
+  Reader reader(data, size);
+  T value{};
+  decode(reader, value);
+  return value;
+}
+
+template <>
+struct Decoder<bool> {
+  void operator()(Reader& reader, bool& value) const { value = reader.read_bool(); }
+};
+
+template <typename T>
+struct Decoder<T, std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value>> {
+  void operator()(Reader& reader, T& value) const {
+    uint64_t positive;
+    int64_t negative;
+    if (reader.read_integer(positive, negative)) {
+      if (std::is_unsigned<T>::value || negative < static_cast<int64_t>(std::numeric_limits<T>::min()))
+        throw msgpack::type_error();
+      value = static_cast<T>(negative);
+    } else {
+      if (positive > static_cast<uint64_t>(std::numeric_limits<T>::max()))
+        throw msgpack::type_error();
+      value = static_cast<T>(positive);
+    }
+  }
+};
+
+template <typename T>
+struct Decoder<T, std::enable_if_t<std::is_floating_point<T>::value>> {
+  void operator()(Reader& reader, T& value) const { value = static_cast<T>(reader.read_float()); }
+};
+
+template <>
+struct Decoder<std::string> {
+  void operator()(Reader& reader, std::string& value) const {
+    const char* data;
+    auto size = reader.read_raw(data);
+    value.assign(data, size);
+  }
+};
+
+template <typename A>
+struct Decoder<std::vector<unsigned char, A>> {
+  void operator()(Reader& reader, std::vector<unsigned char, A>& value) const {
+    const char* data;
+    auto size = reader.read_raw(data);
+    value.assign(data, data + size);
+  }
+};
+
+template <typename A>
+struct Decoder<std::vector<char, A>> {
+  void operator()(Reader& reader, std::vector<char, A>& value) const {
+    const char* data;
+    auto size = reader.read_raw(data);
+    value.assign(data, data + size);
+  }
+};
+
+template <typename T, typename A>
+struct Decoder<std::vector<T, A>> {
+  void operator()(Reader& reader, std::vector<T, A>& value) const {
+    auto size = reader.read_array();
+    value.resize(size);
+    for (auto& element : value) {
+      decode(reader, element);
+    }
+  }
+};
+
+// Elements of std::vector<bool> are proxies, not bool&
+template <typename A>
+struct Decoder<std::vector<bool, A>> {
+  void operator()(Reader& reader, std::vector<bool, A>& value) const {
+    auto size = reader.read_array();
+    value.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+      value[i] = reader.read_bool();
+    }
+  }
+};
+
+template <typename T>
+struct Decoder<boost::optional<T>> {
+  void operator()(Reader& reader, boost::optional<T>& value) const {
+    if (reader.read_nil()) {
+      value = boost::none;
+    } else {
+      if (!value)
+        value = T();
+      decode(reader, *value);
+    }
+  }
+};
+
+template <typename T>
+struct Decoder<T, std::enable_if_t<is_reflected<T>::value>> {
+  // Same semantics as MSGPACK_DEFINE_ARRAY: missing trailing fields keep their
+  // default values and extra elements are ignored
+  void operator()(Reader& reader, T& value) const {
+    auto size = reader.read_array();
+    uint32_t index = 0;
+    auto field = [&](auto& member) {
+      if (index < size) {
+        decode(reader, member);
+        ++index;
+      }
+      return 0;
+    };
+    value.is_reflect([&](auto&... fields) {
+      int expand[] = {0, field(fields)...};
+      (void)expand;
+    });
+    for (; index < size; ++index) {
+      reader.skip();
+    }
+  }
+};
+
+}  // ::codec
+}  // ::is
+
+#endif  // __IS_CODEC_HPP__
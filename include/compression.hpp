@@ -0,0 +1,177 @@
+#ifndef __IS_COMPRESSION_HPP__
+#define __IS_COMPRESSION_HPP__
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#ifdef IS_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef IS_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+/*
+  Optional compression stage for message bodies. A compressed body is
+  signalled by the ContentEncoding "msgpack+<codec>", see is::msgpack.
+
+  Codecs are looked up by name in a process wide registry. The built-in lz4
+  and zstd codecs are compiled in with -DIS_WITH_LZ4 / -DIS_WITH_ZSTD (linking
+  -llz4 / -lzstd); other codecs can be added with compression::add. Codec
+  objects are shared between threads, so any scratch state must be kept per
+  thread (see the built-in ones).
+
+  The decompressed size declared by a body is checked against the codec
+  max_size before allocating, so a malformed or hostile message cannot make
+  a subscriber allocate gigabytes. Raise it for larger messages, e.g.
+  compression::find("zstd")->max_size = 1 << 30.
+*/
+
+namespace is {
+namespace compression {
+
+struct Codec {
+  size_t max_size = 64 << 20;  // Largest decompressed body accepted [bytes]
+
+  virtual ~Codec() {}
+  virtual std::string name() const = 0;
+  // Both methods replace the contents of 'out'
+  virtual void compress(const char* data, size_t size, std::string& out) = 0;
+  virtual void decompress(const char* data, size_t size, std::string& out) = 0;
+
+ protected:
+  // Call before allocating the decompressed body
+  void check_size(uint64_t declared) const {
+    if (declared > max_size)
+      throw std::runtime_error(name() + " body declares " + std::to_string(declared) +
+                               " bytes, above the " + std::to_string(max_size) + " limit");
+  }
+};
+
+struct Policy {
+  std::string codec;        // Registered codec name, empty disables compression
+  size_t threshold = 4096;  // Bodies smaller than this are sent uncompressed
+};
+
+namespace detail {
+
+inline void put_size(std::string& out, uint32_t size) {
+  for (int i = 0; i < 4; ++i) {
+    out[i] = static_cast<char>(size >> (8 * i));
+  }
+}
+
+inline uint32_t get_size(const char* data) {
+  uint32_t size = 0;
+  for (int i = 0; i < 4; ++i) {
+    size |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+  }
+  return size;
+}
+
+}  // ::detail
+
+#ifdef IS_WITH_LZ4
+// LZ4 block format prefixed by the uncompressed size (4 bytes little endian)
+struct Lz4 : public Codec {
+  int acceleration;
+
+  Lz4(int acceleration = 1) : acceleration(acceleration) {}
+
+  std::string name() const override { return "lz4"; }
+
+  void compress(const char* data, size_t size, std::string& out) override {
+    thread_local std::unique_ptr<char[]> state(new char[LZ4_sizeofState()]);
+    out.resize(4 + LZ4_compressBound(size));
+    detail::put_size(out, size);
+    auto n = LZ4_compress_fast_extState(state.get(), data, &out[4], size, out.size() - 4,
+                                        acceleration);
+    if (n <= 0)
+      throw std::runtime_error("lz4 compression failed");
+    out.resize(4 + n);
+  }
+
+  void decompress(const char* data, size_t size, std::string& out) override {
+    if (size < 4)
+      throw std::runtime_error("lz4 body too short");
+    auto original = detail::get_size(data);
+    check_size(original);
+    // LZ4 cannot compress more than 255:1, larger sizes are corrupt
+    if (original > 255 * static_cast<uint64_t>(size - 4) + 16)
+      throw std::runtime_error("lz4 body declares an impossible size");
+    out.resize(original);
+    auto n = LZ4_decompress_safe(data + 4, &out[0], size - 4, out.size());
+    if (n < 0 || static_cast<size_t>(n) != out.size())
+      throw std::runtime_error("lz4 decompression failed");
+  }
+};
+#endif  // IS_WITH_LZ4
+
+#ifdef IS_WITH_ZSTD
+struct Zstd : public Codec {
+  int level;
+
+  Zstd(int level = 1) : level(level) {}
+
+  std::string name() const override { return "zstd"; }
+
+  void compress(const char* data, size_t size, std::string& out) override {
+    thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(),
+                                                                           ZSTD_freeCCtx);
+    out.resize(ZSTD_compressBound(size));
+    auto n = ZSTD_compressCCtx(context.get(), &out[0], out.size(), data, size, level);
+    if (ZSTD_isError(n))
+      throw std::runtime_error(ZSTD_getErrorName(n));
+    out.resize(n);
+  }
+
+  void decompress(const char* data, size_t size, std::string& out) override {
+    thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(),
+                                                                           ZSTD_freeDCtx);
+    auto original = ZSTD_getFrameContentSize(data, size);
+    if (original == ZSTD_CONTENTSIZE_UNKNOWN || original == ZSTD_CONTENTSIZE_ERROR)
+      throw std::runtime_error("zstd frame without content size");
+    check_size(original);
+    out.resize(original);
+    auto n = ZSTD_decompressDCtx(context.get(), &out[0], out.size(), data, size);
+    if (ZSTD_isError(n))
+      throw std::runtime_error(ZSTD_getErrorName(n));
+  }
+};
+#endif  // IS_WITH_ZSTD
+
+using Registry = std::unordered_map<std::string, std::shared_ptr<Codec>>;
+
+inline Registry& registry() {
+  static Registry codecs = []() {
+    Registry codecs;
+#ifdef IS_WITH_LZ4
+    codecs.emplace("lz4", std::make_shared<Lz4>());
+#endif
+#ifdef IS_WITH_ZSTD
+    codecs.emplace("zstd", std::make_shared<Zstd>());
+#endif
+    return codecs;
+  }();
+  return codecs;
+}
+
+// Not thread safe, register codecs before publishing/consuming
+inline void add(std::shared_ptr<Codec> const& codec) {
+  registry()[codec->name()] = codec;
+}
+
+inline Codec* find(std::string const& name) {
+  auto&& codecs = registry();
+  auto codec = codecs.find(name);
+  return codec != codecs.end() ? codec->second.get() : nullptr;
+}
+
+}  // ::compression
+}  // ::is
+
+#endif  // __IS_COMPRESSION_HPP__
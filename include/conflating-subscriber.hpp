@@ -0,0 +1,195 @@
+#ifndef __IS_CONFLATING_SUBSCRIBER_HPP__
+#define __IS_CONFLATING_SUBSCRIBER_HPP__
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "executor.hpp"
+#include "helpers.hpp"
+#include "logger.hpp"
+
+namespace is {
+
+using namespace AmqpClient;
+
+/*
+  Single producer, single consumer "latest value" slot (triple buffer). The
+  writer never waits for the reader and the reader always gets the newest
+  value written, together with how many values were overwritten unread.
+*/
+class LatestSlot {
+  struct Value {
+    Envelope::ptr_t envelope;
+    uint64_t sequence = 0;
+  };
+
+  Value buffers[3];
+  std::atomic<uint8_t> middle{1};  // Index of the shared buffer, bit 2 set if unread
+  uint8_t back = 0;                // Writer only
+  uint8_t front = 2;               // Reader only
+  uint64_t written = 0;            // Writer only
+  uint64_t read = 0;               // Reader only
+
+ public:
+  void write(Envelope::ptr_t envelope) {
+    buffers[back].envelope = std::move(envelope);
+    buffers[back].sequence = ++written;
+    back = middle.exchange(back | 4, std::memory_order_acq_rel) & 3;
+  }
+
+  // Returns false if nothing was written since the previous read
+  bool take(Envelope::ptr_t& envelope, uint64_t& skipped) {
+    if (!(middle.load(std::memory_order_acquire) & 4))
+      return false;
+    front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+    auto& value = buffers[front];
+    skipped = value.sequence - read - 1;
+    read = value.sequence;
+    envelope = std::move(value.envelope);
+    return true;
+  }
+};  // ::LatestSlot
+
+struct Latest {
+  Envelope::ptr_t envelope;  // nullptr if nothing new arrived
+  uint64_t skipped = 0;      // Newer messages that replaced unread ones since the last take
+};
+
+/*
+  Subscription that only keeps the newest message per routing key. A thread
+  with its own channel drains the queue as fast as messages arrive and
+  overwrites the slot of their routing key, so slow readers (UIs, viewers)
+  always get the freshest value instead of working through a backlog. Each
+  key must be read from a single thread.
+
+  take(key) looks the slot up in the shared map under its mutex. Readers in a
+  loop should use a Reader (one per thread), or keep the LatestSlot from
+  slot(key) and call its take directly, both lock free.
+*/
+class ConflatingSubscriber {
+  Channel::ptr_t channel;
+  std::string queue;
+  std::string tag;
+
+  std::mutex mutex;  // Guards the map, only taken on the first message of a key
+  std::unordered_map<std::string, std::unique_ptr<LatestSlot>> slots;
+
+  std::atomic<bool> running;
+  std::thread thread;
+
+  void run() {
+    // Local index, the writer only locks the shared map for keys not seen yet
+    std::unordered_map<std::string, LatestSlot*> cache;
+    try {
+      while (running) {
+        Envelope::ptr_t envelope;
+        if (!channel->BasicConsumeMessage(tag, envelope, 100))
+          continue;
+        auto&& key = envelope->RoutingKey();
+        auto cached = cache.find(key);
+        if (cached == cache.end()) {
+          cached = cache.emplace(key, &slot(key)).first;
+        }
+        cached->second->write(std::move(envelope));
+      }
+    } catch (std::exception const& e) {
+      log::error("Conflating subscriber stopped \n\t@reason: \"{}\"", e.what());
+    }
+  }
+
+ public:
+  ConflatingSubscriber(std::string const& uri, std::vector<std::string> const& topics,
+                       std::string const& exchange = "data", int queue_size = 16,
+                       Executor& executor = is::executor())
+      : ConflatingSubscriber(make_channel(uri), topics, exchange, queue_size, executor) {}
+
+  /*
+    The channel is used exclusively by the subscriber thread from now on, which
+    comes from the "network" pool of the executor
+  */
+  ConflatingSubscriber(Channel::ptr_t const& channel, std::vector<std::string> const& topics,
+                       std::string const& exchange = "data", int queue_size = 16,
+                       Executor& executor = is::executor())
+      : channel(channel), running(true) {
+    // queue_name, passive, durable, exclusive, auto_delete
+    Table arguments{{TableKey("x-max-length"), TableValue(queue_size)}};
+    queue = channel->DeclareQueue("", false, false, true, true, arguments);
+    for (auto&& topic : topics) {
+      channel->BindQueue(queue, exchange, topic);
+      // Wildcard topics get their slots when the first message arrives
+      if (topic.find_first_of("*#") == std::string::npos) {
+        slot(topic);
+      }
+    }
+    // no_local, no_ack, exclusive
+    tag = channel->BasicConsume(queue, "", true, true, true);
+    thread = executor.spawn("network", [this]() { run(); });
+  }
+
+  ~ConflatingSubscriber() {
+    running = false;
+    thread.join();
+    channel->DeleteQueue(queue);
+  }
+
+  ConflatingSubscriber(ConflatingSubscriber const&) = delete;
+  ConflatingSubscriber& operator=(ConflatingSubscriber const&) = delete;
+
+  // Slots are never removed, the reference can be kept to skip the lookup
+  LatestSlot& slot(std::string const& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto&& slot = slots[key];
+    if (slot == nullptr) {
+      slot.reset(new LatestSlot);
+    }
+    return *slot;
+  }
+
+  // Takes the map mutex, see Reader
+  Latest take(std::string const& key) {
+    Latest latest;
+    slot(key).take(latest.envelope, latest.skipped);
+    return latest;
+  }
+
+  // Reads through a local index, only locking the map on the first take of each key
+  class Reader {
+    ConflatingSubscriber& subscriber;
+    std::unordered_map<std::string, LatestSlot*> cache;
+
+   public:
+    explicit Reader(ConflatingSubscriber& subscriber) : subscriber(subscriber) {}
+
+    Latest take(std::string const& key) {
+      auto cached = cache.find(key);
+      if (cached == cache.end()) {
+        cached = cache.emplace(key, &subscriber.slot(key)).first;
+      }
+      Latest latest;
+      cached->second->take(latest.envelope, latest.skipped);
+      return latest;
+    }
+  };  // ::Reader
+
+  // One per reading thread, must not outlive the subscriber
+  Reader reader() { return Reader(*this); }
+
+  std::vector<std::string> keys() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> keys;
+    keys.reserve(slots.size());
+    for (auto&& slot : slots) {
+      keys.push_back(slot.first);
+    }
+    return keys;
+  }
+};  // ::ConflatingSubscriber
+
+}  // ::is
+
+#endif  // __IS_CONFLATING_SUBSCRIBER_HPP__
@@ -5,8 +5,10 @@
 #include <algorithm>
 #include <chrono>
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
+#include "ack-batcher.hpp"
 #include "helpers.hpp"
 
 namespace is {
@@ -21,17 +23,101 @@ struct QueueInfo {
   QueueInfo(std::string const& name, std::string const& tag) : name(name), tag(tag) {}
 };
 
+/*
+  Matching logic behind Connection::consume_sync, kept apart from the channel so
+  it can be driven by any envelope source.
+*/
+
+// Replaces the oldest envelope until all timestamps are within period_ms
+template <typename Consume>
+void sync_envelopes(std::vector<Envelope::ptr_t>& envelopes, Consume&& replace_oldest,
+                    int64_t period_ms) {
+  while (1) {
+    auto minmax =
+        std::minmax_element(std::begin(envelopes), std::end(envelopes), [](auto lhs, auto rhs) {
+          return lhs->Message()->Timestamp() < rhs->Message()->Timestamp();
+        });
+    auto min = (*minmax.first)->Message()->Timestamp();
+    auto max = (*minmax.second)->Message()->Timestamp();
+
+    auto diff_ms = duration_cast<milliseconds>(nanoseconds(max - min)).count();
+    if (diff_ms < period_ms) {
+      break;
+    }
+
+    replace_oldest(std::distance(std::begin(envelopes), minmax.first));
+  }
+}
+
+// One envelope per stream, consume(i) returns the next envelope of the i-th stream
+template <typename Consume>
+std::vector<Envelope::ptr_t> sync_streams(size_t n, Consume&& consume, int64_t period_ms) {
+  std::vector<Envelope::ptr_t> envelopes;
+  envelopes.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    envelopes.emplace_back(consume(i));
+  }
+
+  sync_envelopes(envelopes, [&](size_t oldest) { envelopes[oldest] = consume(oldest); },
+                 period_ms);
+  return envelopes;
+}
+
+// One envelope per topic, all topics arriving through consume()
+template <typename Consume>
+std::vector<Envelope::ptr_t> sync_topics(std::vector<std::string> topics, Consume&& consume,
+                                         int64_t period_ms) {
+  std::vector<Envelope::ptr_t> envelopes(topics.size());
+  std::sort(std::begin(topics), std::end(topics));
+
+  auto index_of = [&](Envelope::ptr_t const& envelope) -> int64_t {
+    auto&& key = envelope->RoutingKey();
+    auto it = std::lower_bound(std::begin(topics), std::end(topics), key);
+    return (it != std::end(topics) && *it == key) ? std::distance(std::begin(topics), it) : -1;
+  };
+
+  int n_unitialized = topics.size();
+  while (n_unitialized) {
+    auto envelope = consume();
+    auto el = index_of(envelope);
+    if (el >= 0) {
+      if (envelopes[el] == nullptr) {
+        --n_unitialized;
+      }
+      envelopes[el] = envelope;
+    }
+  }
+
+  sync_envelopes(envelopes,
+                 [&](size_t) {
+                   auto envelope = consume();
+                   auto el = index_of(envelope);
+                   if (el >= 0) {
+                     envelopes[el] = envelope;
+                   }
+                 },
+                 period_ms);
+  return envelopes;
+}
+
 struct Connection {
   Channel::ptr_t channel;
+  // For reliable subscriptions, shared by the copies of the connection since they share the channel
+  std::shared_ptr<AckBatchers> acks;
 
   Connection(std::string const& uri, std::string const& exchange = "data")
       : Connection(make_channel(uri), exchange) {}
 
-  Connection(Channel::ptr_t channel, std::string const& exchange = "data") : channel(channel) {
+  Connection(Channel::ptr_t channel, std::string const& exchange = "data")
+      : channel(channel), acks(std::make_shared<AckBatchers>(channel)) {
     // passive durable auto_delete
     channel->DeclareExchange(exchange, Channel::EXCHANGE_TYPE_TOPIC, false, false, false);
   }
 
+  /*
+    False if the message was returned (mandatory and unroutable) or rejected
+    by the broker, e.g. nacked by a full reliable subscription queue.
+  */
   bool publish(std::string const& topic, BasicMessage::ptr_t message,
                std::string const& exchange = "data", bool mandatory = false) {
     try {
@@ -39,7 +125,9 @@ struct Connection {
         set_timestamp(message);
       }
       channel->BasicPublish(exchange, topic, message, mandatory);
-    } catch (MessageReturnedException) {
+    } catch (MessageReturnedException const&) {
+      return false;
+    } catch (MessageRejectedException const&) {
       return false;
     }
     return true;
@@ -53,16 +141,14 @@ struct Connection {
     return subscribe(topics, exchange, queue_size);
   }
 
+  // 'arguments' are extra queue arguments, e.g. x-max-priority
   QueueInfo subscribe(std::vector<std::string> const& topics, std::string const& exchange = "data",
-                      int queue_size = 32) {
-    // queue_name, passive, durable, exclusive, auto_delete
-    std::string queue;
+                      int queue_size = 32, Table arguments = Table()) {
     if (queue_size) {
-      Table arguments{{TableKey("x-max-length"), TableValue(queue_size)}};
-      queue = channel->DeclareQueue("", false, false, true, true, arguments);
-    } else {
-      queue = channel->DeclareQueue("", false, false, true, true);
+      arguments[TableKey("x-max-length")] = TableValue(queue_size);
     }
+    // queue_name, passive, durable, exclusive, auto_delete
+    auto queue = channel->DeclareQueue("", false, false, true, true, arguments);
 
     for (auto topic : topics) {
       channel->BindQueue(queue, exchange, topic);
@@ -75,86 +161,111 @@ struct Connection {
     return info;
   }
 
-  Envelope::ptr_t consume(QueueInfo const& info) { return channel->BasicConsumeMessage(info.tag); }
+  /*
+    Reliable subscription: nothing is dropped silently, at most 'max_in_flight'
+    messages are delivered without being acknowledged with ack(), and once the
+    queue holds 'queue_size' messages the broker rejects new publishes
+    (reported to publishers using confirms) instead of dropping the oldest.
+  */
+  QueueInfo subscribe_reliable(std::vector<std::string> const& topics,
+                               uint16_t max_in_flight = 32, std::string const& exchange = "data",
+                               int queue_size = 1024) {
+    // queue_name, passive, durable, exclusive, auto_delete
+    Table arguments{{TableKey("x-max-length"), TableValue(queue_size)},
+                    {TableKey("x-overflow"), TableValue("reject-publish")}};
+    auto queue = channel->DeclareQueue("", false, false, true, true, arguments);
+
+    for (auto topic : topics) {
+      channel->BindQueue(queue, exchange, topic);
+    }
+
+    // no_local, no_ack, exclusive, message_prefetch_count
+    auto tag = channel->BasicConsume(queue, "", true, false, true, max_in_flight);
+
+    QueueInfo info(queue, tag);
+    return info;
+  }
+
+  QueueInfo subscribe_reliable(std::string const& topic, uint16_t max_in_flight = 32,
+                               std::string const& exchange = "data", int queue_size = 1024) {
+    std::vector<std::string> topics{topic};
+    return subscribe_reliable(topics, max_in_flight, exchange, queue_size);
+  }
+
+  // Acknowledges a message of a reliable subscription, in consumption order
+  void ack(Envelope::ptr_t const& envelope) { acks->ack(envelope); }
+
+  /*
+    Acknowledges reliable subscriptions together every 'messages' messages or
+    'delay', batching each subscription apart (see AckBatchers). Applies to
+    every copy of this connection. Keep 'messages' below max_in_flight.
+  */
+  void batch_acks(size_t messages, milliseconds delay = milliseconds(10)) {
+    acks->flush();
+    *acks = AckBatchers(channel, messages, delay);
+  }
+
+  Envelope::ptr_t consume(QueueInfo const& info) {
+    // Pending acks may hold back the next deliveries, send them once they are due
+    Envelope::ptr_t envelope;
+    while (acks->pending() &&
+           !channel->BasicConsumeMessage(info.tag, envelope, acks->timeout_ms())) {
+      acks->flush();
+    }
+    return envelope != nullptr ? envelope : channel->BasicConsumeMessage(info.tag);
+  }
 
   template <typename Time>
   Envelope::ptr_t consume_for(QueueInfo const& info, Time const& timeout) {
     int timeout_ms = duration_cast<milliseconds>(timeout).count();
     Envelope::ptr_t envelope;
+    if (acks->pending() && acks->timeout_ms() < timeout_ms) {
+      auto due = acks->timeout_ms();
+      if (channel->BasicConsumeMessage(info.tag, envelope, due))
+        return envelope;
+      acks->flush();
+      timeout_ms -= due;
+    }
     channel->BasicConsumeMessage(info.tag, envelope, timeout_ms);
     return envelope;
   }
 
-  std::vector<Envelope::ptr_t> consume_sync(std::vector<QueueInfo> const& infos,
-                                            int64_t period_ms) {
-    std::vector<Envelope::ptr_t> envelopes;
-    envelopes.reserve(infos.size());
-    for (auto& info : infos) {
-      auto envelope = consume(info);
-      envelopes.emplace_back(envelope);
+  /*
+    Envelopes already received, up to 'max_n', into 'batch' (cleared first,
+    reuse it to keep its capacity). Blocks until at least one arrives.
+  */
+  size_t consume_batch(QueueInfo const& info, std::vector<Envelope::ptr_t>& batch, size_t max_n) {
+    batch.clear();
+    while (acks->pending() &&
+           !is::consume_batch(channel, info.tag, batch, max_n, acks->timeout_ms())) {
+      acks->flush();
     }
+    return batch.empty() ? is::consume_batch(channel, info.tag, batch, max_n, -1) : batch.size();
+  }
 
-    while (1) {
-      auto minmax =
-          std::minmax_element(std::begin(envelopes), std::end(envelopes), [](auto lhs, auto rhs) {
-            return lhs->Message()->Timestamp() < rhs->Message()->Timestamp();
-          });
-      auto min = (*minmax.first)->Message()->Timestamp();
-      auto max = (*minmax.second)->Message()->Timestamp();
-
-      auto diff_ms = duration_cast<milliseconds>(nanoseconds(max - min)).count();
-      if (diff_ms < period_ms) {
-        break;
-      }
-
-      auto min_el = std::distance(std::begin(envelopes), minmax.first);
-      envelopes[min_el] = consume(infos[min_el]);
+  // Same as above, waiting at most 'timeout' for the first envelope
+  template <typename Time>
+  size_t consume_batch(QueueInfo const& info, std::vector<Envelope::ptr_t>& batch, size_t max_n,
+                       Time const& timeout) {
+    int timeout_ms = duration_cast<milliseconds>(timeout).count();
+    if (acks->pending() && acks->timeout_ms() < timeout_ms) {
+      auto due = acks->timeout_ms();
+      if (is::consume_batch(channel, info.tag, batch, max_n, due))
+        return batch.size();
+      acks->flush();
+      timeout_ms -= due;
     }
+    return is::consume_batch(channel, info.tag, batch, max_n, timeout_ms);
+  }
 
-    return envelopes;
+  std::vector<Envelope::ptr_t> consume_sync(std::vector<QueueInfo> const& infos,
+                                            int64_t period_ms) {
+    return sync_streams(infos.size(), [&](size_t i) { return consume(infos[i]); }, period_ms);
   }
 
   std::vector<Envelope::ptr_t> consume_sync(QueueInfo const& info, std::vector<std::string> topics,
                                             int64_t period_ms) {
-    std::vector<Envelope::ptr_t> envelopes(topics.size());
-    std::sort(std::begin(topics), std::end(topics));
-
-    int n_unitialized = topics.size();
-    while (n_unitialized) {
-      auto envelope = consume(info);
-
-      auto it = std::lower_bound(std::begin(topics), std::end(topics), envelope->RoutingKey());
-      if (it != std::end(topics)) {
-        auto el = std::distance(std::begin(topics), it);
-        if (envelopes[el] == nullptr) {
-          --n_unitialized;
-        }
-        envelopes[el] = envelope;
-      }
-    }
-
-    while (1) {
-      auto minmax =
-          std::minmax_element(std::begin(envelopes), std::end(envelopes), [](auto lhs, auto rhs) {
-            return lhs->Message()->Timestamp() < rhs->Message()->Timestamp();
-          });
-      auto min = (*minmax.first)->Message()->Timestamp();
-      auto max = (*minmax.second)->Message()->Timestamp();
-
-      auto diff_ms = duration_cast<milliseconds>(nanoseconds(max - min)).count();
-      if (diff_ms < period_ms) {
-        break;
-      }
-
-      auto envelope = consume(info);
-      auto it = std::lower_bound(std::begin(topics), std::end(topics), envelope->RoutingKey());
-      if (it != std::end(topics)) {
-        auto el = std::distance(std::begin(topics), it);
-        envelopes[el] = envelope;
-      }
-    }
-
-    return envelopes;
+    return sync_topics(std::move(topics), [&]() { return consume(info); }, period_ms);
   }
 
   void wait_event(std::string const& event, std::function<bool(Table)> predicate) {
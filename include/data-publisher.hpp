@@ -41,7 +41,7 @@ struct DataPublisher {
       n = has_consumers ? n + 1 : n;
     };
 
-    watcher.watch_for(1ms, [&](auto table) {
+    watcher.watch_batch_for(1ms, 64, [&](auto table) {
       auto&& topic = table["routing_key"].GetString();
       auto&& key_value = generators.find(topic);
       if (key_value != generators.end()) {
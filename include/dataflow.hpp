@@ -0,0 +1,476 @@
+#ifndef __IS_DATAFLOW_HPP__
+#define __IS_DATAFLOW_HPP__
+
+#include <boost/optional.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bounded-ring.hpp"
+#include "connection.hpp"
+#include "executor.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "packer.hpp"
+
+/*
+  Stream processing graphs: typed nodes, each running on its own thread,
+  connected by bounded in-memory queues. Values travel between nodes as C++
+  objects, only the subscribe and publish nodes touch the broker and the
+  serializer.
+
+    is::dataflow::Graph graph(uri);
+    auto packets = graph.subscribe<is::TheoraPacket>("webcam.frame");
+    auto frames = graph.map("decode", packets, [&](auto& p) { return decoder.decode(p); });
+    auto small = graph.map("resize", frames, [](cv::Mat& frame) { return half(frame); });
+    graph.publish(small, "webcam.small");
+    graph.start();
+
+  A function returning boost::optional<T> emits only the values it has.
+  Nodes sleep while their input is empty and queues block the upstream node
+  when full, so a slow node backs up to the subscribe nodes, whose broker
+  queues then drop the oldest messages. A stream feeding several nodes hands
+  each one a copy of every value (cheap for cv::Mat, which shares its pixels:
+  treat them as read only).
+*/
+
+namespace is {
+namespace dataflow {
+
+struct NodeStats {
+  std::string name;
+  std::atomic<uint64_t> received{0};  // Values taken from the input (messages for subscribe)
+  std::atomic<uint64_t> emitted{0};   // Values sent downstream (messages for publish)
+  std::atomic<uint64_t> dropped{0};   // Messages that failed to decode
+  metrics::LatencyHistogram busy;     // Time spent on each value [ns]
+  metrics::LatencyHistogram latency;  // Source message timestamp to the end of the node [ns]
+};
+
+namespace detail {
+
+template <typename T>
+struct Item {
+  T value;
+  uint64_t timestamp;  // Of the message the value comes from [ns since epoch]
+};
+
+// Edge between two nodes, each side sleeps while it cannot make progress
+template <typename T>
+using Queue = BlockingRing<Item<T>>;
+
+// Bounds the waits of nodes, to notice a stopped graph
+constexpr milliseconds max_wait(100);
+
+inline uint64_t now() {
+  return system_clock::now().time_since_epoch().count();
+}
+
+inline uint64_t since(steady_clock::time_point start) {
+  return duration_cast<nanoseconds>(steady_clock::now() - start).count();
+}
+
+// Output of a node, one queue per downstream node
+template <typename T>
+struct Port {
+  std::vector<std::shared_ptr<Queue<T>>> queues;
+  std::atomic<bool> open{true};  // Cleared after the last value was emitted
+
+  // Blocks while a downstream queue is full, false if the graph stopped meanwhile
+  bool emit(Item<T>& item, std::atomic<bool> const& running) {
+    for (size_t i = 0; i < queues.size(); ++i) {
+      Item<T> copy;
+      if (i + 1 < queues.size()) {
+        copy = item;
+      } else {
+        copy = std::move(item);
+      }
+      while (!queues[i]->push_for(copy, max_wait, [&]() { return !running; })) {
+        if (!running)
+          return false;
+      }
+    }
+    return true;
+  }
+
+  // After the last value, wakes the downstream nodes to drain their queues
+  void close() {
+    open = false;
+    for (auto&& queue : queues) {
+      queue->ring();
+    }
+  }
+};
+
+// Emitted type of node functions, unwrapping boost::optional
+template <typename R>
+struct Result {
+  using type = R;
+  static bool has(R const&) { return true; }
+  static R& get(R& result) { return result; }
+};
+
+// Input of a node, false once stopped or when upstream closed and the queue is empty
+template <typename T>
+bool pop(Queue<T>& queue, Port<T> const& upstream, Item<T>& item,
+         std::atomic<bool> const& running) {
+  auto done = [&]() { return !upstream.open || !running; };
+  while (!queue.pop_for(item, max_wait, done)) {
+    if (!running)
+      return false;
+    if (!upstream.open)
+      return queue.try_pop(item);
+  }
+  return true;
+}
+
+template <typename R>
+struct Result<boost::optional<R>> {
+  using type = R;
+  static bool has(boost::optional<R> const& result) { return static_cast<bool>(result); }
+  static R& get(boost::optional<R>& result) { return *result; }
+};
+
+struct Node {
+  NodeStats stats;
+  std::string pool = "graph";
+
+  explicit Node(std::string const& name) { stats.name = name; }
+  virtual ~Node() {}
+
+  // Runs until the input ends or the graph stops, clearing 'running' on failure
+  virtual void run(std::atomic<bool>& running) = 0;
+
+  void record(uint64_t timestamp) {
+    if (timestamp != 0) {
+      auto now = detail::now();
+      stats.latency.record(now > timestamp ? now - timestamp : 0);
+    }
+  }
+};
+
+template <typename T>
+struct SubscribeNode : Node {
+  Port<T> out;
+  std::string uri, topic, exchange;
+  int queue_size;
+
+  SubscribeNode(std::string const& uri, std::string const& topic, std::string const& exchange,
+                int queue_size)
+      : Node("subscribe(" + topic + ")"),
+        uri(uri),
+        topic(topic),
+        exchange(exchange),
+        queue_size(queue_size) {}
+
+  void run(std::atomic<bool>& running) override {
+    try {
+      Connection is(make_channel(uri), exchange);
+      auto queue = is.subscribe(topic, exchange, queue_size);
+      while (running) {
+        auto envelope = is.consume_for(queue, milliseconds(100));
+        if (envelope == nullptr)
+          continue;
+        auto start = steady_clock::now();
+        stats.received.fetch_add(1, std::memory_order_relaxed);
+        Item<T> item;
+        try {
+          item.value = msgpack<T>(envelope);
+        } catch (std::exception const&) {
+          stats.dropped.fetch_add(1, std::memory_order_relaxed);
+          continue;
+        }
+        item.timestamp = envelope->Message()->Timestamp();
+        stats.busy.record(since(start));
+        if (!out.emit(item, running))
+          break;
+        stats.emitted.fetch_add(1, std::memory_order_relaxed);
+        record(item.timestamp);
+      }
+      is.unsubscribe(queue);
+    } catch (std::exception const& e) {
+      log::error("Node \"{}\" stopped \n\t@reason: \"{}\"", stats.name, e.what());
+      running = false;
+    }
+    out.close();
+  }
+};
+
+template <typename T, typename F>
+struct GenerateNode : Node {
+  Port<T> out;
+  F generate;
+
+  GenerateNode(std::string const& name, F generate) : Node(name), generate(std::move(generate)) {}
+
+  void run(std::atomic<bool>& running) override {
+    try {
+      while (running) {
+        auto start = steady_clock::now();
+        Item<T> item;
+        if (!generate(item.value))
+          break;
+        item.timestamp = detail::now();
+        stats.busy.record(since(start));
+        if (!out.emit(item, running))
+          break;
+        stats.emitted.fetch_add(1, std::memory_order_relaxed);
+      }
+    } catch (std::exception const& e) {
+      log::error("Node \"{}\" stopped \n\t@reason: \"{}\"", stats.name, e.what());
+      running = false;
+    }
+    out.close();
+  }
+};
+
+template <typename In, typename Out, typename F>
+struct MapNode : Node {
+  std::shared_ptr<Queue<In>> in;
+  Port<In> const& upstream;
+  Port<Out> out;
+  F function;
+
+  MapNode(std::string const& name, Port<In>& upstream, size_t depth, F function)
+      : Node(name),
+        in(std::make_shared<Queue<In>>(depth)),
+        upstream(upstream),
+        function(std::move(function)) {}
+
+  void run(std::atomic<bool>& running) override {
+    using R = decltype(function(std::declval<In&>()));
+    try {
+      Item<In> item;
+      while (pop(*in, upstream, item, running)) {
+        auto start = steady_clock::now();
+        stats.received.fetch_add(1, std::memory_order_relaxed);
+        auto result = function(item.value);
+        stats.busy.record(since(start));
+        if (Result<R>::has(result)) {
+          Item<Out> output{std::move(Result<R>::get(result)), item.timestamp};
+          if (!out.emit(output, running))
+            break;
+          stats.emitted.fetch_add(1, std::memory_order_relaxed);
+        }
+        record(item.timestamp);
+      }
+    } catch (std::exception const& e) {
+      log::error("Node \"{}\" stopped \n\t@reason: \"{}\"", stats.name, e.what());
+      running = false;
+    }
+    out.close();
+  }
+};
+
+template <typename In, typename F>
+struct SinkNode : Node {
+  std::shared_ptr<Queue<In>> in;
+  Port<In> const& upstream;
+  F function;
+
+  SinkNode(std::string const& name, Port<In>& upstream, size_t depth, F function)
+      : Node(name),
+        in(std::make_shared<Queue<In>>(depth)),
+        upstream(upstream),
+        function(std::move(function)) {}
+
+  void run(std::atomic<bool>& running) override {
+    try {
+      Item<In> item;
+      while (pop(*in, upstream, item, running)) {
+        auto start = steady_clock::now();
+        stats.received.fetch_add(1, std::memory_order_relaxed);
+        function(item.value);
+        stats.busy.record(since(start));
+        record(item.timestamp);
+      }
+    } catch (std::exception const& e) {
+      log::error("Node \"{}\" stopped \n\t@reason: \"{}\"", stats.name, e.what());
+      running = false;
+    }
+  }
+};
+
+template <typename In>
+struct PublishNode : Node {
+  std::shared_ptr<Queue<In>> in;
+  Port<In> const& upstream;
+  std::string uri, topic, exchange;
+
+  PublishNode(std::string const& uri, Port<In>& upstream, size_t depth, std::string const& topic,
+              std::string const& exchange)
+      : Node("publish(" + topic + ")"),
+        in(std::make_shared<Queue<In>>(depth)),
+        upstream(upstream),
+        uri(uri),
+        topic(topic),
+        exchange(exchange) {}
+
+  void run(std::atomic<bool>& running) override {
+    try {
+      Connection is(make_channel(uri), exchange);
+      Item<In> item;
+      while (pop(*in, upstream, item, running)) {
+        auto start = steady_clock::now();
+        stats.received.fetch_add(1, std::memory_order_relaxed);
+        auto message = is::msgpack(item.value);
+        if (item.timestamp != 0) {
+          message->Timestamp(item.timestamp);  // End to end latency downstream
+        }
+        is.publish(topic, message, exchange);
+        stats.busy.record(since(start));
+        stats.emitted.fetch_add(1, std::memory_order_relaxed);
+        record(item.timestamp);
+      }
+    } catch (std::exception const& e) {
+      log::error("Node \"{}\" stopped \n\t@reason: \"{}\"", stats.name, e.what());
+      running = false;
+    }
+  }
+};
+
+}  // ::detail
+
+// Values of type T flowing out of a node, T must be default constructible
+template <typename T>
+class Stream {
+  friend class Graph;
+  detail::Port<T>* port;
+  explicit Stream(detail::Port<T>& port) : port(&port) {}
+};
+
+/*
+  Nodes are added before start() and run on threads of the "graph" pool of
+  the executor, see place() to put some elsewhere. Each edge is a queue of
+  'depth' values.
+*/
+class Graph {
+ public:
+  explicit Graph(std::string const& uri, size_t depth = 4) : uri(uri), depth(depth) {}
+
+  ~Graph() { stop(); }
+
+  Graph(Graph const&) = delete;
+  Graph& operator=(Graph const&) = delete;
+
+  // External input: messages of the topic decoded as T
+  template <typename T>
+  Stream<T> subscribe(std::string const& topic, std::string const& exchange = "data",
+                      int queue_size = 8) {
+    auto node = add(new detail::SubscribeNode<T>(uri, topic, exchange, queue_size));
+    return Stream<T>(node->out);
+  }
+
+  // In process source, generate(T&) returns false to end the stream
+  template <typename T, typename F>
+  Stream<T> generate(std::string const& name, F generate) {
+    auto node = add(new detail::GenerateNode<T, F>(name, std::move(generate)));
+    return Stream<T>(node->out);
+  }
+
+  // Emits function(value&) for every value, function may move from it
+  template <typename In, typename F, typename R = decltype(std::declval<F&>()(std::declval<In&>())),
+            typename Out = typename std::decay<typename detail::Result<R>::type>::type>
+  Stream<Out> map(std::string const& name, Stream<In> const& input, F function) {
+    auto node = add(new detail::MapNode<In, Out, F>(name, *input.port, depth, std::move(function)));
+    input.port->queues.push_back(node->in);
+    return Stream<Out>(node->out);
+  }
+
+  template <typename In, typename F>
+  void sink(std::string const& name, Stream<In> const& input, F function) {
+    auto node = add(new detail::SinkNode<In, F>(name, *input.port, depth, std::move(function)));
+    input.port->queues.push_back(node->in);
+  }
+
+  // External output: values published as msgpack, with the timestamp of their source message
+  template <typename In>
+  void publish(Stream<In> const& input, std::string const& topic,
+               std::string const& exchange = "data") {
+    auto node = add(new detail::PublishNode<In>(uri, *input.port, depth, topic, exchange));
+    input.port->queues.push_back(node->in);
+  }
+
+  // Runs the node on a thread of another executor pool, call before start()
+  void place(std::string const& node, std::string const& pool) { find(node).pool = pool; }
+
+  // A graph runs once: throws std::logic_error if started again after it finished
+  void start(Executor& executor = is::executor()) {
+    if (!threads.empty())
+      return;
+    if (started) {
+      throw std::logic_error("The graph already ran");
+    }
+    started = true;
+    running = true;
+    for (auto&& node : nodes) {
+      auto raw = node.get();
+      threads.push_back(executor.spawn(raw->pool, [this, raw]() { raw->run(running); }));
+    }
+  }
+
+  // Waits for every node to finish, i.e. for the generated streams to end
+  void wait() {
+    for (auto&& thread : threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+    threads.clear();
+  }
+
+  // Stops all nodes, values still queued are discarded
+  void stop() {
+    running = false;
+    wait();
+  }
+
+  // Statistics of every node, in the order they were added
+  std::vector<NodeStats const*> stats() const {
+    std::vector<NodeStats const*> stats;
+    for (auto&& node : nodes) {
+      stats.push_back(&node->stats);
+    }
+    return stats;
+  }
+
+ private:
+  const std::string uri;
+  const size_t depth;
+  std::vector<std::unique_ptr<detail::Node>> nodes;
+  std::atomic<bool> running{false};
+  bool started = false;
+  std::vector<std::thread> threads;
+
+  template <typename N>
+  N* add(N* node) {
+    std::unique_ptr<N> owned(node);
+    if (started) {
+      throw std::logic_error("Nodes must be added before the graph starts");
+    }
+    for (auto&& other : nodes) {
+      if (other->stats.name == node->stats.name) {
+        throw std::invalid_argument("Duplicate node \"" + node->stats.name + "\"");
+      }
+    }
+    nodes.emplace_back(std::move(owned));
+    return node;
+  }
+
+  detail::Node& find(std::string const& name) {
+    for (auto&& node : nodes) {
+      if (node->stats.name == name)
+        return *node;
+    }
+    throw std::invalid_argument("Unknown node \"" + name + "\"");
+  }
+};  // ::Graph
+
+}  // ::dataflow
+}  // ::is
+
+#endif  // __IS_DATAFLOW_HPP__
@@ -10,6 +10,7 @@ struct EventWatcher {
 
   Connection is;
   QueueInfo events;
+  std::vector<Envelope::ptr_t> batch;  // Reused by watch_batch_for
 
   EventWatcher(Connection connection, std::string const& topic,
                std::string const& exchange = "amq.rabbitmq.event")
@@ -24,6 +25,18 @@ struct EventWatcher {
       on_event(event->Message()->HeaderTable());
     }
   }
+
+  // Handles up to 'max_n' events already received, waiting at most 'timeout' for the first
+  template <typename Time>
+  size_t watch_batch_for(Time const& timeout, size_t max_n, std::function<void(Table)> on_event) {
+    is.consume_batch(events, batch, max_n, timeout);
+    for (auto&& event : batch) {
+      if (event->Message()->HeaderTableIsSet()) {
+        on_event(event->Message()->HeaderTable());
+      }
+    }
+    return batch.size();
+  }
 };  //:: EventWatcher
 
 }  // ::is
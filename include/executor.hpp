@@ -0,0 +1,312 @@
+#ifndef __IS_EXECUTOR_HPP__
+#define __IS_EXECUTOR_HPP__
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "logger.hpp"
+
+namespace is {
+
+// Parses kernel cpu lists such as "0-3,8,10-11"
+inline std::vector<int> parse_cpus(std::string const& list) {
+  std::vector<int> cpus;
+  size_t pos = 0;
+  while (pos < list.size()) {
+    auto end = list.find(',', pos);
+    auto range = list.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    int first, last;
+    auto n = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+    if (n >= 1) {
+      for (int cpu = first; cpu <= (n == 2 ? last : first); ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (end == std::string::npos)
+      break;
+    pos = end + 1;
+  }
+  return cpus;
+}
+
+// CPUs of a NUMA node, empty if the node does not exist (or there is no sysfs)
+inline std::vector<int> node_cpus(int node) {
+  std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+  std::string list;
+  std::getline(file, list);
+  return parse_cpus(list);
+}
+
+// Restricts the thread to the CPUs, an empty list allows all of them
+inline bool pin_thread(pthread_t thread, std::vector<int> const& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (cpus.empty()) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  for (auto cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(thread, sizeof set, &set) == 0;
+}
+
+/*
+  Named group of threads sharing a CPU placement. Long running loops get a
+  thread of their own with spawn(), short tasks are queued with post() and run
+  by 'workers' threads started on the first post. Pinning a pool to the CPUs
+  of one NUMA node also keeps what its threads allocate on that node, as
+  Linux places pages on the node of the thread that first touches them.
+  Placement changes apply to the threads already running.
+*/
+class ThreadPool {
+ public:
+  struct Usage {
+    size_t threads;   // Running now, spawned and workers
+    uint64_t tasks;   // Posted tasks completed
+    size_t pending;   // Posted tasks waiting for a worker
+    uint64_t cpu;     // CPU time used by all the pool threads so far [ns]
+    size_t capacity;  // Pinned CPUs, or threads when not pinned
+  };
+
+  explicit ThreadPool(std::string const& name, std::vector<int> const& cpus = {},
+                      size_t workers = 1)
+      : name(name), cpus(cpus), n_workers(std::max<size_t>(workers, 1)) {}
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto&& worker : workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+
+  std::string const& pool_name() const { return name; }
+
+  void pin(std::vector<int> const& cpus) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->cpus = cpus;
+    for (auto&& thread : running) {
+      pin_thread(thread.second.handle, cpus);
+    }
+  }
+
+  // The thread must not outlive the pool
+  std::thread spawn(std::function<void()> body) {
+    return std::thread([this, body]() {
+      Member member(*this);
+      body();
+    });
+  }
+
+  void post(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(std::move(task));
+      if (workers.size() < n_workers && idle == 0) {
+        workers.push_back(spawn([this]() { work(); }));
+      }
+    }
+    wake.notify_one();
+  }
+
+  Usage usage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Usage usage{running.size(), completed, tasks.size(), finished, 0};
+    for (auto&& thread : running) {
+      timespec time;
+      if (clock_gettime(thread.second.clock, &time) == 0) {
+        usage.cpu += time.tv_sec * 1000000000ull + time.tv_nsec;
+      }
+    }
+    usage.capacity = cpus.empty() ? running.size() : cpus.size();
+    return usage;
+  }
+
+ private:
+  struct Thread {
+    pthread_t handle;
+    clockid_t clock;  // CPU time of the thread
+  };
+
+  // Registers the calling thread while in scope
+  struct Member {
+    ThreadPool& pool;
+    explicit Member(ThreadPool& pool) : pool(pool) {
+      auto self = pthread_self();
+      pthread_setname_np(self, pool.name.substr(0, 15).c_str());
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      if (!pool.cpus.empty() && !pin_thread(self, pool.cpus)) {
+        log::warn("Failed to pin a \"{}\" thread", pool.name);
+      }
+      Thread thread{self, CLOCK_THREAD_CPUTIME_ID};
+      pthread_getcpuclockid(self, &thread.clock);
+      pool.running.emplace(std::this_thread::get_id(), thread);
+    }
+    ~Member() {
+      timespec time;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      pool.finished += time.tv_sec * 1000000000ull + time.tv_nsec;
+      pool.running.erase(std::this_thread::get_id());
+    }
+  };
+
+  const std::string name;
+  std::vector<int> cpus;
+  const size_t n_workers;
+
+  mutable std::mutex mutex;
+  std::unordered_map<std::thread::id, Thread> running;
+  uint64_t finished = 0;  // CPU time of the threads that exited [ns]
+
+  std::condition_variable wake;
+  std::deque<std::function<void()>> tasks;
+  std::vector<std::thread> workers;
+  size_t idle = 0;
+  uint64_t completed = 0;
+  bool stopping = false;
+
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      ++idle;
+      wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      --idle;
+      if (tasks.empty())
+        return;
+      auto task = std::move(tasks.front());
+      tasks.pop_front();
+      lock.unlock();
+      try {
+        task();
+      } catch (std::exception const& e) {
+        log::error("Task of pool \"{}\" failed \n\t@reason: \"{}\"", name, e.what());
+      }
+      lock.lock();
+      ++completed;
+    }
+  }
+};  // ::ThreadPool
+
+/*
+  Named thread pools, created unpinned on first use. Library components take
+  their threads from these pools, so placing a pool places them:
+
+    "network"     subscriber and publisher loops (PriorityLanes, ConflatingSubscriber)
+    "services"    providers started with advertise()
+    "capture"     CameraPipeline capture, its publisher runs on "network"
+    "encode"      CameraPipeline encoder
+    "decode"      FrameHub
+    "graph"       dataflow::Graph nodes, unless placed elsewhere
+    "background"  housekeeping such as ClockSync
+
+  Configure the placement before starting components, e.g. on a two socket box
+
+    auto&& executor = is::executor();
+    executor.configure("network", is::node_cpus(0));
+    executor.configure("encode", is::node_cpus(1));
+*/
+class Executor {
+ public:
+  struct Sample {
+    std::string pool;
+    ThreadPool::Usage usage;
+    double cores;        // CPU time per wall time since the previous sample
+    double utilization;  // cores / capacity
+  };
+
+  ThreadPool& pool(std::string const& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto&& pool = pools[name];
+    if (pool.pool == nullptr) {
+      pool.pool.reset(new ThreadPool(name));
+      names.push_back(name);
+    }
+    return *pool.pool;
+  }
+
+  /*
+    Pins the pool (an empty list unpins it), a new pool also gets 'workers'
+    threads for posted tasks
+  */
+  ThreadPool& configure(std::string const& name, std::vector<int> const& cpus,
+                        size_t workers = 1) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto&& pool = pools[name];
+    if (pool.pool == nullptr) {
+      pool.pool.reset(new ThreadPool(name, cpus, workers));
+      names.push_back(name);
+    } else {
+      pool.pool->pin(cpus);
+    }
+    return *pool.pool;
+  }
+
+  std::thread spawn(std::string const& pool, std::function<void()> body) {
+    return this->pool(pool).spawn(std::move(body));
+  }
+
+  void post(std::string const& pool, std::function<void()> task) {
+    this->pool(pool).post(std::move(task));
+  }
+
+  // Usage of every pool, in creation order. Call from a single thread
+  std::vector<Sample> sample() {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    std::vector<Sample> samples;
+    for (auto&& name : names) {
+      auto&& pool = pools[name];
+      auto usage = pool.pool->usage();
+      auto wall = std::chrono::duration<double, std::nano>(now - pool.last_sample).count();
+      auto cores = wall > 0 ? (usage.cpu - pool.last_cpu) / wall : 0.0;
+      samples.push_back(Sample{name, usage, cores, usage.capacity ? cores / usage.capacity : 0.0});
+      pool.last_sample = now;
+      pool.last_cpu = usage.cpu;
+    }
+    return samples;
+  }
+
+ private:
+  struct Entry {
+    std::unique_ptr<ThreadPool> pool;
+    std::chrono::steady_clock::time_point last_sample = std::chrono::steady_clock::now();
+    uint64_t last_cpu = 0;
+  };
+
+  std::mutex mutex;
+  std::unordered_map<std::string, Entry> pools;
+  std::vector<std::string> names;
+};  // ::Executor
+
+// Process wide executor used by the library components by default
+inline Executor& executor() {
+  // Never destroyed, detached threads may still be running during static destruction
+  static Executor* executor = new Executor;
+  return *executor;
+}
+
+}  // ::is
+
+#endif  // __IS_EXECUTOR_HPP__
@@ -0,0 +1,284 @@
+#ifndef __IS_FIBER_SERVICE_PROVIDER_HPP__
+#define __IS_FIBER_SERVICE_PROVIDER_HPP__
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <boost/fiber/all.hpp>
+#include <chrono>
+#include <climits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "executor.hpp"
+#include "helpers.hpp"
+#include "logger.hpp"
+#include "service-provider.hpp"
+
+/*
+  Service provider that runs every request handler in its own fiber. Handlers
+  keep the service_handle_t signature but may call other services with
+  is::fiber::call (or wait with boost::this_fiber::sleep_for), which suspends
+  only the calling fiber while the provider keeps serving other requests on
+  the same thread. Requires linking boost_fiber and boost_context.
+
+    is::Reply pose(is::Request req) {
+      auto a = is::fiber::request("camera.0.get_pose", is::msgpack(""));
+      auto b = is::fiber::request("camera.1.get_pose", is::msgpack(""));
+      ... a.wait_for(100ms) ... b.get() ...
+    }
+
+  All fibers and the channel belong to the thread calling listen(), several
+  providers with the same name can run on different threads to share a queue.
+*/
+
+namespace is {
+
+class FiberServiceProvider;
+
+namespace fiber {
+
+using future_t = boost::fibers::future<Envelope::ptr_t>;
+
+// Provider running on the calling thread, set by FiberServiceProvider::listen
+inline FiberServiceProvider*& current() {
+  thread_local FiberServiceProvider* provider = nullptr;
+  return provider;
+}
+
+namespace detail {
+
+// Handed from the scheduler to the listen loop once no fiber is ready
+struct Idle {
+  boost::fibers::mutex mutex;
+  boost::fibers::condition_variable ready;
+  // Earliest wake up of a sleeping or timed waiting fiber, min() until reported
+  std::chrono::steady_clock::time_point deadline;
+};
+
+/*
+  Round robin scheduling that does not block the thread when every fiber is
+  waiting: it reports the earliest fiber deadline and wakes the listen loop,
+  which then blocks on the channel until that deadline (or a message).
+*/
+class Scheduler : public boost::fibers::algo::algorithm {
+ public:
+  explicit Scheduler(std::shared_ptr<Idle> const& idle) : idle(idle) {}
+
+  void awakened(boost::fibers::context* context) noexcept override {
+    fibers.awakened(context);
+  }
+  boost::fibers::context* pick_next() noexcept override { return fibers.pick_next(); }
+  bool has_ready_fibers() const noexcept override { return fibers.has_ready_fibers(); }
+
+  void suspend_until(std::chrono::steady_clock::time_point const& time) noexcept override {
+    idle->deadline = time;
+    idle->ready.notify_one();
+  }
+  void notify() noexcept override {}
+
+ private:
+  boost::fibers::algo::round_robin fibers;
+  std::shared_ptr<Idle> idle;
+};
+
+// Milliseconds until the deadline for BasicConsumeMessage, -1 for none
+inline int timeout_until(std::chrono::steady_clock::time_point const& deadline) {
+  using namespace std::chrono;
+  if (deadline == steady_clock::time_point::max())
+    return -1;
+  auto left = duration_cast<microseconds>(deadline - steady_clock::now()).count();
+  return static_cast<int>(std::min<int64_t>(std::max<int64_t>((left + 999) / 1000, 0), INT_MAX));
+}
+
+}  // ::detail
+
+}  // ::fiber
+
+class FiberServiceProvider {
+  const std::string name;
+  Channel::ptr_t channel;
+  const std::string exchange;
+  const uint16_t max_concurrency;
+
+  ServiceDispatcher dispatcher;
+
+  std::string rpc_queue;
+  std::string rpc_tag;
+  int correlation_id;
+  std::unordered_map<std::string, boost::fibers::promise<Envelope::ptr_t>> pending;
+  size_t active;
+  std::shared_ptr<fiber::detail::Idle> idle;
+
+ public:
+  FiberServiceProvider(std::string const& name, Channel::ptr_t const& channel,
+                       std::string const& exchange = "services", uint16_t max_concurrency = 64)
+      : name(name),
+        channel(channel),
+        exchange(exchange),
+        max_concurrency(max_concurrency),
+        dispatcher(exchange),
+        correlation_id(0),
+        active(0),
+        idle(std::make_shared<fiber::detail::Idle>()) {
+    // passive durable auto_delete
+    channel->DeclareExchange(exchange, Channel::EXCHANGE_TYPE_TOPIC, false, false, false);
+    // passive, durable, exclusive, auto_delete
+    Table arguments{{TableKey("x-expires"), TableValue(30000)},
+                    {TableKey("x-max-length"), TableValue(32)}};
+    channel->DeclareQueue(name, false, false, false, false, arguments);
+
+    // Replies to requests made by the handlers
+    rpc_queue = channel->DeclareQueue("", false, false, true, true);
+    channel->BindQueue(rpc_queue, exchange, rpc_queue);
+  }
+
+  void expose(std::string const& binding, service_handle_t service) {
+    auto topic = name + '.' + binding;
+    channel->BindQueue(name, exchange, topic);
+    dispatcher.add(topic, service);
+  }
+
+  // Exposes an idempotent service whose reply is cached, see ReplyCache
+  void expose(std::string const& binding, service_handle_t service, CachePolicy const& policy) {
+    auto topic = name + '.' + binding;
+    channel->BindQueue(name, exchange, topic);
+    dispatcher.add(topic, service, policy);
+  }
+
+  // Thread safe, the next request runs the service again
+  void invalidate(std::string const& binding) { dispatcher.invalidate(name + '.' + binding); }
+
+  ServiceStats const& stats() const { return dispatcher.stats(); }
+
+  // Must be called from a handler running on this provider
+  fiber::future_t request(std::string const& route, BasicMessage::ptr_t message) {
+    auto id = std::to_string(correlation_id++);
+    message->CorrelationId(id);
+
+    auto&& promise = pending[id];
+    auto future = promise.get_future();
+    try {
+      auto&& pos = route.find_first_of(';');
+      if (pos == std::string::npos || pos + 1 > route.size()) {
+        message->ReplyTo(rpc_queue);
+        channel->BasicPublish(exchange, route, message, true);
+      } else {
+        message->ReplyTo(route.substr(pos + 1) + ';' + rpc_queue);
+        channel->BasicPublish(exchange, route.substr(0, pos), message, true);
+      }
+    } catch (MessageReturnedException const&) {
+      log::warn("No route for {}", route);
+      promise.set_value(nullptr);
+      pending.erase(id);
+    }
+    return future;
+  }
+
+  // Suspends the calling fiber until the reply arrives, nullptr on timeout
+  template <typename Time>
+  Envelope::ptr_t call(std::string const& route, BasicMessage::ptr_t message,
+                       Time const& timeout) {
+    auto future = request(route, message);
+    if (future.wait_for(timeout) != boost::fibers::future_status::ready) {
+      pending.erase(message->CorrelationId());
+      return nullptr;
+    }
+    return future.get();
+  }
+
+  void listen() {
+    fiber::current() = this;
+    boost::fibers::use_scheduling_algorithm<fiber::detail::Scheduler>(idle);
+
+    // no_local, no_ack, exclusive, message_prefetch_count
+    auto tag = channel->BasicConsume(name, "", true, false, false, max_concurrency);
+    rpc_tag = channel->BasicConsume(rpc_queue, "", true, true, true);
+
+    log::info("Listening for service requests");
+
+    while (1) {
+      // Run the handlers until none is ready, then wait on the channel until the earliest
+      // of their deadlines, or forever while no handler is running
+      auto timeout = -1;
+      if (active) {
+        std::unique_lock<boost::fibers::mutex> lock(idle->mutex);
+        idle->deadline = std::chrono::steady_clock::time_point::min();
+        idle->ready.wait(lock, [this]() {
+          return idle->deadline != std::chrono::steady_clock::time_point::min();
+        });
+        timeout = fiber::detail::timeout_until(idle->deadline);
+      }
+      Envelope::ptr_t envelope;
+      if (channel->BasicConsumeMessage(envelope, timeout)) {
+        if (envelope->ConsumerTag() == rpc_tag) {
+          on_reply(envelope);
+        } else if (envelope->ConsumerTag() == tag) {
+          on_request(envelope);
+        }
+      }
+    }
+  }
+
+ private:
+  void on_reply(Envelope::ptr_t const& reply) {
+    auto promise = pending.find(reply->Message()->CorrelationId());
+    if (promise != pending.end()) {
+      promise->second.set_value(reply);
+      pending.erase(promise);
+    }
+  }
+
+  void on_request(Request const& request) {
+    ++active;
+    boost::fibers::fiber([this, request]() {
+      // An exception escaping a fiber terminates the process
+      try {
+        dispatcher.dispatch(*channel, request);
+        channel->BasicAck(request);
+      } catch (std::exception const& e) {
+        log::error("Failed to handle request \"{}\" \n\t@reason: \"{}\"",
+                   request->RoutingKey(), e.what());
+      }
+      --active;
+    }).detach();
+  }
+};  // ::FiberServiceProvider
+
+namespace fiber {
+
+inline FiberServiceProvider& provider() {
+  if (current() == nullptr)
+    throw std::logic_error("is::fiber calls must be made from a FiberServiceProvider handler");
+  return *current();
+}
+
+inline future_t request(std::string const& route, BasicMessage::ptr_t message) {
+  return provider().request(route, message);
+}
+
+template <typename Time>
+Envelope::ptr_t call(std::string const& route, BasicMessage::ptr_t message, Time const& timeout) {
+  return provider().call(route, message, timeout);
+}
+
+}  // ::fiber
+
+inline std::thread advertise_fibers(std::string const& uri, std::string const& name,
+                                    std::vector<service_t> const& services,
+                                    uint16_t max_concurrency = 64,
+                                    Executor& executor = is::executor()) {
+  auto thread = executor.spawn("services", [=]() {
+    FiberServiceProvider provider(name, make_channel(uri), "services", max_concurrency);
+    for (auto& service : services) {
+      provider.expose(service.name, service.handle);
+    }
+    provider.listen();
+  });
+
+  return thread;
+}
+
+}  // ::is
+
+#endif  // __IS_FIBER_SERVICE_PROVIDER_HPP__
@@ -0,0 +1,362 @@
+#ifndef __IS_FRAME_HUB_HPP__
+#define __IS_FRAME_HUB_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "bounded-ring.hpp"
+#include "connection.hpp"
+#include "executor.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "packer.hpp"
+#include "service-client.hpp"
+#include "theora-decoder.hpp"
+
+namespace is {
+
+// Decoded frame shared by every local subscriber of a stream, clone() the image to modify it
+struct DecodedFrame {
+  std::string topic;
+  uint64_t timestamp;  // Of the packet message [ns since epoch]
+  uint64_t sequence;   // Frames decoded from the stream so far
+  cv::Mat image;
+};
+
+using FramePtr = std::shared_ptr<const DecodedFrame>;
+
+/*
+  Frames of one local subscriber. The stream pushes from its thread and the
+  subscriber pops from another, sleeping only while the queue is empty. It
+  holds at most 'depth' frames: when full, DROP_OLDEST keeps the freshest
+  frames (a depth of 1 always gives the latest one) while DROP_NEWEST keeps
+  the queued ones.
+*/
+class FrameQueue {
+ public:
+  enum Policy { DROP_OLDEST, DROP_NEWEST };
+
+  FrameQueue(size_t depth = 1, Policy policy = DROP_OLDEST)
+      : depth(std::max<size_t>(depth, 1)), policy(policy), frames(depth) {}
+
+  FrameQueue(FrameQueue const&) = delete;
+  FrameQueue& operator=(FrameQueue const&) = delete;
+
+  // Frames discarded because this subscriber fell behind
+  uint64_t dropped() const { return discarded.load(std::memory_order_relaxed); }
+
+  // Approximate number of frames waiting
+  size_t pending() const { return frames.size(); }
+
+  // Producer only
+  void push(FramePtr frame) {
+    // The ring capacity is a power of two, the depth is enforced here
+    if (frames.size() >= depth) {
+      if (policy == DROP_NEWEST) {
+        discarded.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      FramePtr oldest;
+      while (frames.size() >= depth && frames.try_pop(oldest)) {
+        discarded.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    frames.try_push(frame);
+  }
+
+  bool try_pop(FramePtr& frame) { return frames.try_pop(frame); }
+
+  template <typename Time>
+  bool pop_for(FramePtr& frame, Time const& timeout) {
+    return frames.pop_for(frame, timeout);
+  }
+
+  FramePtr pop() {
+    FramePtr frame;
+    while (!pop_for(frame, milliseconds(100))) {
+    }
+    return frame;
+  }
+
+ private:
+  const size_t depth;
+  const Policy policy;
+  BlockingRing<FramePtr> frames;
+  std::atomic<uint64_t> discarded{0};
+};  // ::FrameQueue
+
+/*
+  One Theora stream decoded once for all its local subscribers: each decoded
+  frame is allocated once and only its pointer is pushed to every queue.
+  Subscribers are dropped once nobody else holds their queue. Kept apart from
+  the channel so it can be fed from any packet source; single threaded.
+*/
+class FrameStream {
+ public:
+  explicit FrameStream(std::string const& topic) : topic(topic), decoder(new TheoraDecoder) {}
+
+  void add(std::shared_ptr<FrameQueue> queue) { queues.push_back(std::move(queue)); }
+
+  // Removes the queues only this stream holds, true if none is left
+  bool prune() {
+    queues.erase(std::remove_if(queues.begin(), queues.end(),
+                                [](auto&& queue) { return queue.use_count() == 1; }),
+                 queues.end());
+    return queues.empty();
+  }
+
+  size_t subscribers() const { return queues.size(); }
+
+  // Until headers arrive in band or through set_headers, packets are useless
+  bool needs_headers() const { return decoder->state == TheoraDecoder::NEW_CONTEXT; }
+
+  void set_headers(std::vector<TheoraPacket> const& headers) { decoder->set_headers(headers); }
+
+  // Decodes the packet and pushes the frame, if any, to every queue. Returns true on a frame
+  bool feed(TheoraPacket const& packet, uint64_t timestamp) {
+    if (needs_headers() && !packet.new_header)
+      return false;
+    auto image = decoder->decode(packet);
+    if (!image)
+      return false;
+
+    auto frame = std::make_shared<DecodedFrame>();
+    frame->topic = topic;
+    frame->timestamp = timestamp;
+    frame->sequence = decoded++;
+    frame->image = std::move(*image);
+    FramePtr shared = std::move(frame);
+    for (auto&& queue : queues) {
+      queue->push(shared);
+    }
+    return true;
+  }
+
+ private:
+  const std::string topic;
+  std::unique_ptr<TheoraDecoder> decoder;
+  std::vector<std::shared_ptr<FrameQueue>> queues;
+  uint64_t decoded = 0;
+};  // ::FrameStream
+
+/*
+  Per process hub of camera streams: a single subscription and decoder per
+  stream no matter how many components (detector, tracker, viewer) consume
+  it, each through its own FrameQueue with its own depth and drop policy.
+  The hub thread owns the channel and the decoders; subscribe() is thread
+  safe and takes effect on the next loop. Streams with no subscribers left
+  are unbound and stop being decoded.
+
+    FrameHub hub(uri);
+    auto frames = hub.subscribe("webcam.frame");
+    hub.start();
+    for (;;) cv::imshow("webcam", frames->pop()->image);
+
+  Stream headers are requested from "<camera>.get_headers", e.g.
+  "webcam.get_headers" for "webcam.frame", unless another service is given.
+  The hub never waits for the reply, it is handled by the loop when it comes.
+*/
+class FrameHub {
+ public:
+  struct Stats {
+    std::atomic<uint64_t> packets{0};  // Received, all streams
+    std::atomic<uint64_t> frames{0};   // Decoded, all streams
+    std::atomic<uint64_t> dropped{0};  // Packets and headers replies that failed to decode
+    metrics::LatencyHistogram decode;  // Time to decode and fan out a packet [ns]
+  };
+
+  Stats stats;
+
+  FrameHub(std::string const& uri, std::string const& exchange = "data", int queue_size = 32)
+      : FrameHub(make_channel(uri), exchange, queue_size) {}
+
+  // The channel is only used by the hub thread once started
+  FrameHub(Channel::ptr_t const& channel, std::string const& exchange = "data",
+           int queue_size = 32)
+      : is(channel, exchange),
+        client(channel),
+        exchange(exchange),
+        queue(is.subscribe(std::vector<std::string>{}, exchange, queue_size)) {}
+
+  ~FrameHub() { stop(); }
+
+  FrameHub(FrameHub const&) = delete;
+  FrameHub& operator=(FrameHub const&) = delete;
+
+  // Frames of the stream published on 'topic', the subscription ends with the last copy
+  std::shared_ptr<FrameQueue> subscribe(std::string const& topic, size_t depth = 1,
+                                        FrameQueue::Policy policy = FrameQueue::DROP_OLDEST,
+                                        std::string const& headers_service = "") {
+    auto queue = std::make_shared<FrameQueue>(depth, policy);
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(Pending{topic, headers_service, queue});
+    changed.store(true, std::memory_order_release);
+    return queue;
+  }
+
+  // The hub thread comes from the "decode" pool of the executor
+  void start(Executor& executor = is::executor()) {
+    if (running.exchange(true))
+      return;
+    thread = executor.spawn("decode", [this]() { loop(); });
+  }
+
+  void stop() {
+    running = false;
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+ private:
+  struct Pending {
+    std::string topic;
+    std::string headers_service;
+    std::shared_ptr<FrameQueue> queue;
+  };
+
+  struct Stream {
+    FrameStream frames;
+    std::string headers_service;
+    steady_clock::time_point last_request;
+    std::string request;  // Correlation id of the headers request in flight, empty if none
+  };
+
+  Connection is;
+  ServiceClient client;
+  const std::string exchange;
+  const QueueInfo queue;
+  std::unordered_map<std::string, std::unique_ptr<Stream>> streams;  // Bound topics, hub thread
+  std::unordered_map<std::string, std::string> requests;  // Headers requests in flight, id -> topic
+
+  std::mutex mutex;
+  std::vector<Pending> pending;  // Guarded by the mutex
+  std::atomic<bool> changed{false};
+
+  std::atomic<bool> running{false};
+  std::thread thread;
+
+  static std::string headers_of(std::string const& topic) {
+    auto dot = topic.rfind('.');
+    return (dot == std::string::npos ? topic : topic.substr(0, dot)) + ".get_headers";
+  }
+
+  void apply() {
+    std::vector<Pending> added;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      added.swap(pending);
+      changed.store(false, std::memory_order_relaxed);
+    }
+    for (auto&& subscriber : added) {
+      auto&& stream = streams[subscriber.topic];
+      if (stream == nullptr) {
+        auto service = subscriber.headers_service.empty() ? headers_of(subscriber.topic)
+                                                          : subscriber.headers_service;
+        stream.reset(new Stream{FrameStream(subscriber.topic), service, {}, ""});
+        is.channel->BindQueue(queue.name, exchange, subscriber.topic);
+      }
+      stream->frames.add(std::move(subscriber.queue));
+    }
+  }
+
+  // Asks the camera for the headers, at most once per second per stream
+  void request_headers(std::string const& topic, Stream& stream) {
+    auto now = steady_clock::now();
+    if (now - stream.last_request < seconds(1))
+      return;
+    stream.last_request = now;
+    if (!stream.request.empty()) {
+      log::warn("No reply from \"{}\", waiting for in band headers", stream.headers_service);
+      requests.erase(stream.request);
+    }
+    stream.request = client.request(stream.headers_service, msgpack(""));
+    requests.emplace(stream.request, topic);
+  }
+
+  // Applies the headers replies already received, without waiting
+  void receive_headers() {
+    while (!requests.empty()) {
+      auto reply = client.receive_for(milliseconds(0));
+      if (reply == nullptr)
+        return;
+      auto request = requests.find(reply->Message()->CorrelationId());
+      if (request == requests.end())
+        continue;  // Late reply of a request already given up
+      auto found = streams.find(request->second);
+      requests.erase(request);
+      if (found == streams.end())
+        continue;
+      auto&& stream = *found->second;
+      stream.request.clear();
+      if (stream.frames.needs_headers()) {
+        try {
+          stream.frames.set_headers(msgpack<std::vector<TheoraPacket>>(reply));
+        } catch (std::exception const& e) {
+          // Requested again with the next packet
+          stats.dropped.fetch_add(1, std::memory_order_relaxed);
+          log::warn("Invalid headers from \"{}\": {}", stream.headers_service, e.what());
+        }
+      }
+    }
+  }
+
+  void dispatch(Envelope::ptr_t const& envelope) {
+    auto&& topic = envelope->RoutingKey();
+    auto found = streams.find(topic);
+    if (found == streams.end())
+      return;  // Delivered before the topic was unbound
+    auto&& stream = *found->second;
+    if (stream.frames.prune()) {
+      is.channel->UnbindQueue(queue.name, exchange, topic);
+      requests.erase(stream.request);
+      streams.erase(found);
+      return;
+    }
+
+    auto start = steady_clock::now();
+    TheoraPacket packet;
+    try {
+      packet = msgpack<TheoraPacket>(envelope);
+    } catch (std::exception const&) {
+      stats.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    if (stream.frames.needs_headers() && !packet.new_header) {
+      request_headers(topic, stream);
+    }
+    if (stream.frames.feed(packet, envelope->Message()->Timestamp())) {
+      stats.frames.fetch_add(1, std::memory_order_relaxed);
+    }
+    stats.decode.record(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+  }
+
+  void loop() {
+    try {
+      while (running) {
+        if (changed.load(std::memory_order_acquire)) {
+          apply();
+        }
+        receive_headers();
+        auto envelope = is.consume_for(queue, milliseconds(100));
+        if (envelope == nullptr)
+          continue;
+        stats.packets.fetch_add(1, std::memory_order_relaxed);
+        dispatch(envelope);
+      }
+    } catch (std::exception const& e) {
+      log::error("Frame hub stopped \n\t@reason: \"{}\"", e.what());
+    }
+    running = false;
+  }
+};  // ::FrameHub
+
+}  // ::is
+
+#endif  // __IS_FRAME_HUB_HPP__
@@ -2,9 +2,11 @@
 #define __IS_HELPERS_HPP__
 
 #include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <algorithm>
 #include <memory>
 #include <chrono>
 #include <sstream>
+#include <vector>
 #include "logger.hpp"
 
 namespace is {
@@ -12,7 +14,7 @@ namespace is {
 using namespace std::chrono;
 using namespace AmqpClient;
 
-Channel::ptr_t make_channel(std::string const& uri) {
+inline Channel::ptr_t make_channel(std::string const& uri) {
   log::info("Trying to connect to broker at \"{}\"", uri);
   try {
     auto channel = Channel::CreateFromUri(uri);
@@ -24,16 +26,92 @@ Channel::ptr_t make_channel(std::string const& uri) {
   }
 }
 
-void set_timestamp(BasicMessage::ptr_t message) {
+inline void set_timestamp(BasicMessage::ptr_t message) {
   message->Timestamp(system_clock::now().time_since_epoch().count());
 }
 
-auto latency(Envelope::ptr_t envelope) {
+inline auto latency(Envelope::ptr_t envelope) {
   auto now = system_clock::now().time_since_epoch().count();
   auto diff = nanoseconds(now - envelope->Message()->Timestamp());
   return duration_cast<milliseconds>(diff).count();
 }
 
+/*
+  Request deadlines travel in the "x-deadline" header (nanoseconds since epoch)
+  and as the AMQP expiration, so the broker also drops requests that expire
+  while still queued.
+*/
+inline void set_deadline(BasicMessage::ptr_t message, system_clock::time_point deadline) {
+  auto headers = message->HeaderTableIsSet() ? message->HeaderTable() : Table();
+  headers[TableKey("x-deadline")] =
+      TableValue(static_cast<int64_t>(duration_cast<nanoseconds>(deadline.time_since_epoch()).count()));
+  message->HeaderTable(headers);
+  auto ttl = duration_cast<milliseconds>(deadline - system_clock::now()).count();
+  message->Expiration(std::to_string(std::max<int64_t>(ttl, 0)));
+}
+
+// Returns false if the message carries no deadline
+inline bool get_deadline(BasicMessage::ptr_t const& message, system_clock::time_point& deadline) {
+  if (!message->HeaderTableIsSet())
+    return false;
+  auto headers = message->HeaderTable();
+  auto value = headers.find(TableKey("x-deadline"));
+  if (value == headers.end() || value->second.GetType() != TableValue::VT_int64)
+    return false;
+  deadline = system_clock::time_point(duration_cast<system_clock::duration>(
+      nanoseconds(value->second.GetInt64())));
+  return true;
+}
+
+inline bool expired(Envelope::ptr_t const& envelope,
+                    system_clock::time_point now = system_clock::now()) {
+  system_clock::time_point deadline;
+  return get_deadline(envelope->Message(), deadline) && deadline < now;
+}
+
+/*
+  Same host paths can also stamp CLOCK_MONOTONIC (steady_clock, shared by all
+  processes of a host and never adjusted) in the "x-steady" header [ns], which
+  gives exact latencies on that host. Meaningless across hosts.
+*/
+inline void set_steady_timestamp(BasicMessage::ptr_t message,
+                                 steady_clock::time_point now = steady_clock::now()) {
+  auto headers = message->HeaderTableIsSet() ? message->HeaderTable() : Table();
+  headers[TableKey("x-steady")] =
+      TableValue(static_cast<int64_t>(duration_cast<nanoseconds>(now.time_since_epoch()).count()));
+  message->HeaderTable(headers);
+}
+
+// Returns false if the message carries no steady timestamp
+inline bool get_steady_timestamp(BasicMessage::ptr_t const& message, int64_t& timestamp) {
+  if (!message->HeaderTableIsSet())
+    return false;
+  auto headers = message->HeaderTable();
+  auto value = headers.find(TableKey("x-steady"));
+  if (value == headers.end() || value->second.GetType() != TableValue::VT_int64)
+    return false;
+  timestamp = value->second.GetInt64();
+  return true;
+}
+
+/*
+  Fills 'batch' (cleared first) with up to 'max_n' envelopes of consumer 'tag':
+  waits at most 'timeout_ms' (-1 forever) for the first one, then only takes
+  the ones already received. Reusing 'batch' across calls keeps its capacity.
+*/
+inline size_t consume_batch(Channel::ptr_t const& channel, std::string const& tag,
+                            std::vector<Envelope::ptr_t>& batch, size_t max_n, int timeout_ms) {
+  batch.clear();
+  Envelope::ptr_t envelope;
+  if (max_n == 0 || !channel->BasicConsumeMessage(tag, envelope, timeout_ms))
+    return 0;
+  batch.push_back(std::move(envelope));
+  while (batch.size() < max_n && channel->BasicConsumeMessage(tag, envelope, 0)) {
+    batch.push_back(std::move(envelope));
+  }
+  return batch.size();
+}
+
 }  // ::is
 
 #endif  // __IS_HELPERS_HPP__
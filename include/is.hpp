@@ -1,24 +1,32 @@
 #ifndef __IS_HPP__
 #define __IS_HPP__
 
+#include <map>
 #include <thread>
+#include "batch-publisher.hpp"
+#include "conflating-subscriber.hpp"
 #include "connection.hpp"
 #include "helpers.hpp"
 #include "packer.hpp"
+#include "priority-lanes.hpp"
 #include "service-client.hpp"
+#include "service-host.hpp"
 #include "service-provider.hpp"
 #include "data-publisher.hpp"
 #include "event-watcher.hpp"
+#include "executor.hpp"
 
 namespace is {
 
-Connection connect(std::string const& uri) {
+inline Connection connect(std::string const& uri) {
   return {make_channel(uri)};
 }
 
-std::thread advertise(std::string const& uri, std::string const& name,
-                      std::vector<service_t> const& services) {
-  auto thread = std::thread([=]() {
+// The provider thread comes from the "services" pool of the executor
+inline std::thread advertise(std::string const& uri, std::string const& name,
+                             std::vector<service_t> const& services,
+                             Executor& executor = is::executor()) {
+  auto thread = executor.spawn("services", [=]() {
     ServiceProvider provider(name, make_channel(uri));
     for (auto& service : services) {
       provider.expose(service.name, service.handle);
@@ -29,7 +37,24 @@ std::thread advertise(std::string const& uri, std::string const& name,
   return thread;
 }
 
-ServiceClient make_client(const Connection& c) {
+// Serves all the providers (name -> services) from a single connection and thread
+inline std::thread advertise(std::string const& uri,
+                             std::map<std::string, std::vector<service_t>> const& providers,
+                             Executor& executor = is::executor()) {
+  auto thread = executor.spawn("services", [=]() {
+    ServiceHost host(make_channel(uri));
+    for (auto& provider : providers) {
+      for (auto& service : provider.second) {
+        host.expose(provider.first, service.name, service.handle);
+      }
+    }
+    host.listen();
+  });
+
+  return thread;
+}
+
+inline ServiceClient make_client(const Connection& c) {
   return ServiceClient(c.channel);
 }
 
@@ -0,0 +1,148 @@
+#ifndef __IS_LOCAL_BUS_HPP__
+#define __IS_LOCAL_BUS_HPP__
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bounded-ring.hpp"
+#include "topic-trie.hpp"
+
+namespace is {
+
+using namespace AmqpClient;
+
+/*
+  In-process stand-in for the broker, to load test and benchmark nodes
+  without RabbitMQ: topic exchanges routing messages to bounded queues that
+  drop their oldest message when full (as x-max-length does). Messages are
+  shared between the queues, never copied. It has the BasicPublish of a
+  Channel, so ServiceDispatcher can reply through it.
+
+  Publishing is lock-free once a routing key has been seen: the routes are
+  an immutable snapshot, replaced under the mutex by bind() and by the first
+  publish of each key.
+*/
+class LocalBus {
+ public:
+  // Any number of publishers and of competing consumers
+  class Queue {
+   public:
+    Queue(std::string const& name, size_t max_length) : queue_name(name), envelopes(max_length) {}
+
+    std::string const& name() const { return queue_name; }
+
+    // Messages dropped because the queue was full
+    uint64_t dropped() const { return envelopes.dropped(); }
+
+    size_t size() const { return envelopes.size(); }
+
+    void push(Envelope::ptr_t envelope) { envelopes.push_overwrite(std::move(envelope)); }
+
+    // Same semantics as Channel::BasicConsumeMessage, 0 polls and -1 waits forever
+    bool consume(Envelope::ptr_t& envelope, int timeout_ms = -1) {
+      if (timeout_ms == 0)
+        return envelopes.try_pop(envelope);
+      if (timeout_ms > 0)
+        return envelopes.pop_for(envelope, std::chrono::milliseconds(timeout_ms));
+      while (!envelopes.pop_for(envelope, std::chrono::seconds(1))) {
+      }
+      return true;
+    }
+
+   private:
+    const std::string queue_name;
+    BlockingRing<Envelope::ptr_t> envelopes;
+  };  // ::Queue
+
+  // Returns the existing queue if the name is taken, an empty name generates one
+  std::shared_ptr<Queue> declare(std::string const& name = "", size_t max_length = 32) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto queue_name = name.empty() ? "local.gen-" + std::to_string(generated++) : name;
+    auto&& queue = queues[queue_name];
+    if (queue == nullptr) {
+      queue = std::make_shared<Queue>(queue_name, max_length);
+    }
+    return queue;
+  }
+
+  void bind(std::string const& queue, std::string const& exchange, std::string const& pattern) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = queues.find(queue);
+    if (found == queues.end())
+      return;
+    auto next = std::make_shared<Routes>();
+    next->bindings = std::atomic_load(&routes)->bindings;  // Cached routes are dropped
+    next->bindings.push_back(Binding{exchange, pattern, found->second});
+    std::atomic_store(&routes, std::shared_ptr<const Routes>(std::move(next)));
+  }
+
+  // Messages published with no matching binding
+  uint64_t unroutable() const { return lost.load(std::memory_order_relaxed); }
+
+  void BasicPublish(std::string const& exchange, std::string const& routing_key,
+                    BasicMessage::ptr_t const& message, bool = false, bool = false) {
+    auto key = exchange + '\0' + routing_key;
+    auto current = std::atomic_load(&routes);
+    auto route = current->cache.find(key);
+    if (route == current->cache.end()) {
+      current = add_route(key, exchange, routing_key);
+      route = current->cache.find(key);
+    }
+    if (route->second.empty()) {
+      lost.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    auto tag = sequence.fetch_add(1, std::memory_order_relaxed);
+    for (auto&& queue : route->second) {
+      queue->push(Envelope::Create(message, queue->name(), tag, exchange, false, routing_key, 0));
+    }
+  }
+
+ private:
+  struct Binding {
+    std::string exchange;
+    std::string pattern;
+    std::shared_ptr<Queue> queue;
+  };
+
+  struct Routes {
+    std::vector<Binding> bindings;
+    std::unordered_map<std::string, std::vector<std::shared_ptr<Queue>>> cache;  // exchange\0key
+  };
+
+  std::mutex mutex;  // Serializes changes to the queues and routes
+  std::unordered_map<std::string, std::shared_ptr<Queue>> queues;
+  std::shared_ptr<const Routes> routes = std::make_shared<Routes>();
+  uint64_t generated = 0;
+  std::atomic<uint64_t> sequence{1};
+  std::atomic<uint64_t> lost{0};
+
+  std::shared_ptr<const Routes> add_route(std::string const& key, std::string const& exchange,
+                                          std::string const& routing_key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto current = std::atomic_load(&routes);
+    if (current->cache.count(key))
+      return current;
+    auto next = std::make_shared<Routes>(*current);
+    auto&& matched = next->cache[key];
+    for (auto&& binding : next->bindings) {
+      if (binding.exchange == exchange && topic_matches(binding.pattern, routing_key) &&
+          std::find(matched.begin(), matched.end(), binding.queue) == matched.end()) {
+        matched.push_back(binding.queue);
+      }
+    }
+    std::shared_ptr<const Routes> published(std::move(next));
+    std::atomic_store(&routes, published);
+    return published;
+  }
+};  // ::LocalBus
+
+}  // ::is
+
+#endif  // __IS_LOCAL_BUS_HPP__
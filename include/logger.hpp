@@ -10,7 +10,7 @@ struct Logger {
   Logger() : log(spdlog::stdout_color_mt("is")) { log->set_pattern("[%l][%H:%M:%S:%e][%t] %v"); }
 };
 
-std::shared_ptr<spdlog::logger> logger() {
+inline std::shared_ptr<spdlog::logger> logger() {
   static Logger logger;
   return logger.log;
 }
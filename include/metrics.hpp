@@ -0,0 +1,109 @@
+#ifndef __IS_METRICS_HPP__
+#define __IS_METRICS_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace is {
+namespace metrics {
+
+/*
+  Log-linear histogram for latencies (or any non negative integer), 8 linear
+  sub-buckets per power of two, so quantiles are within 12.5% of the exact
+  value over the whole uint64 range. Recording is a relaxed atomic increment
+  and can be done from any thread; readers take snapshots, and the
+  difference of two snapshots describes the interval between them.
+*/
+class LatencyHistogram {
+ public:
+  static constexpr int sub_bits = 3;
+  static constexpr size_t sub_buckets = 1 << sub_bits;
+  static constexpr size_t n_buckets = (64 - sub_bits + 1) * sub_buckets;
+
+  static size_t bucket(uint64_t value) {
+    if (value < sub_buckets)
+      return value;
+    int msb = 63 - __builtin_clzll(value);
+    auto group = msb - sub_bits + 1;
+    auto sub = (value >> (msb - sub_bits)) & (sub_buckets - 1);
+    return group * sub_buckets + sub;
+  }
+
+  // Largest value that falls in the bucket
+  static uint64_t upper_bound(size_t bucket) {
+    if (bucket < sub_buckets)
+      return bucket;
+    auto group = bucket / sub_buckets;
+    auto sub = sub_buckets + bucket % sub_buckets;
+    return ((sub + 1) << (group - 1)) - 1;
+  }
+
+  struct Snapshot {
+    std::vector<uint64_t> counts = std::vector<uint64_t>(n_buckets, 0);
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    double mean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+
+    // Upper bound of the bucket holding the p-th quantile (0 <= p <= 1), 0 if empty
+    uint64_t quantile(double p) const {
+      if (count == 0)
+        return 0;
+      auto rank = static_cast<uint64_t>(p * (count - 1)) + 1;
+      uint64_t seen = 0;
+      for (size_t i = 0; i < n_buckets; ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+          return upper_bound(i);
+      }
+      return upper_bound(n_buckets - 1);
+    }
+
+    uint64_t max() const { return quantile(1.0); }
+
+    Snapshot operator-(Snapshot const& before) const {
+      Snapshot interval;
+      for (size_t i = 0; i < n_buckets; ++i) {
+        interval.counts[i] = counts[i] - before.counts[i];
+      }
+      interval.count = count - before.count;
+      interval.sum = sum - before.sum;
+      return interval;
+    }
+  };
+
+  LatencyHistogram() {
+    for (auto& count : counts) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  LatencyHistogram(LatencyHistogram const&) = delete;
+  LatencyHistogram& operator=(LatencyHistogram const&) = delete;
+
+  void record(uint64_t value) {
+    counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  Snapshot snapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < n_buckets; ++i) {
+      snapshot.counts[i] = counts[i].load(std::memory_order_relaxed);
+      snapshot.count += snapshot.counts[i];
+    }
+    snapshot.sum = sum.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+ private:
+  std::atomic<uint64_t> counts[n_buckets];
+  std::atomic<uint64_t> sum{0};
+};
+
+}  // ::metrics
+}  // ::is
+
+#endif  // __IS_METRICS_HPP__
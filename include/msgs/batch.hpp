@@ -0,0 +1,108 @@
+#ifndef __IS_MSG_BATCH_HPP__
+#define __IS_MSG_BATCH_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include "../packer.hpp"
+
+namespace is {
+namespace msg {
+namespace common {
+
+/*
+  Several samples of a high rate stream sent as a single message. Sample
+  timestamps are kept as a column of differences to the previous sample
+  (the first one relative to 'start'), which msgpack packs in a few bytes each:
+
+    [start, [0, dt1, dt2, ...], [sample0, sample1, ...]]
+
+  Iterating yields the samples along with their absolute timestamps.
+*/
+template <typename T>
+struct Batch {
+  uint64_t start = 0;           // Timestamp of the first sample [ns since epoch]
+  std::vector<int64_t> deltas;  // Timestamp differences to the previous sample [ns]
+  std::vector<T> samples;
+  IS_DEFINE_MSG(start, deltas, samples);
+
+  struct Sample {
+    uint64_t timestamp;
+    T const& value;
+  };
+
+  class const_iterator {
+    Batch const* batch;
+    size_t index;
+    uint64_t timestamp;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Sample;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Sample;
+
+    const_iterator(Batch const* batch, size_t index)
+        : batch(batch), index(index), timestamp(batch->start) {
+      if (index < batch->size()) {
+        timestamp += batch->deltas[index];
+      }
+    }
+
+    Sample operator*() const { return Sample{timestamp, batch->samples[index]}; }
+
+    const_iterator& operator++() {
+      if (++index < batch->size()) {
+        timestamp += batch->deltas[index];
+      }
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      auto copy = *this;
+      ++*this;
+      return copy;
+    }
+
+    bool operator==(const_iterator const& other) const { return index == other.index; }
+    bool operator!=(const_iterator const& other) const { return index != other.index; }
+  };
+
+  size_t size() const { return std::min(samples.size(), deltas.size()); }
+  bool empty() const { return size() == 0; }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size()); }
+
+  void reserve(size_t n) {
+    deltas.reserve(n);
+    samples.reserve(n);
+  }
+
+  void clear() {
+    deltas.clear();
+    samples.clear();
+  }
+
+  // Only for batches built with push_back, decoded ones do not track the last timestamp
+  void push_back(T const& sample, uint64_t timestamp) {
+    if (samples.empty()) {
+      start = timestamp;
+      last = timestamp;
+    }
+    deltas.push_back(static_cast<int64_t>(timestamp - last));
+    samples.push_back(sample);
+    last = timestamp;
+  }
+
+ private:
+  uint64_t last = 0;  // Timestamp of the last sample pushed, not serialized
+};
+
+}  // ::common
+}  // ::msg
+}  // ::is
+
+#endif  // __IS_MSG_BATCH_HPP__
@@ -31,6 +31,14 @@ struct Timestamp {
   IS_DEFINE_MSG(nanoseconds);
 };
 
+// NTP style clock exchange, all times in nanoseconds since epoch of the respective host
+struct ClockExchange {
+  int64_t request_sent = 0;      // Client clock
+  int64_t request_received = 0;  // Server clock
+  int64_t reply_sent = 0;        // Server clock
+  IS_DEFINE_MSG(request_sent, request_received, reply_sent);
+};
+
 struct SamplingRate {
   boost::optional<double> rate = boost::none;          // [Hz]
   boost::optional<unsigned int> period = boost::none;  // [ms]
@@ -0,0 +1,352 @@
+#ifndef __IS_MSG_POINT_CLOUD_HPP__
+#define __IS_MSG_POINT_CLOUD_HPP__
+
+#include <boost/align/aligned_allocator.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include "../packer.hpp"
+#include "geometry.hpp"
+
+namespace is {
+namespace msg {
+namespace geometry {
+
+/*
+  Structure of arrays alternative to PointsWithReference for large point sets.
+  Coordinates live in three contiguous, cache line aligned columns so they can
+  be processed with vector instructions, and go over the wire as raw little
+  endian msgpack bin blobs instead of one array per point:
+
+    [reference, encoding, size, resolution, [ox, oy, oz], x, y, z]
+
+  The z column is empty when no point has a z coordinate, otherwise points
+  without z hold NaN. Quantized encodings store round((v - o) / resolution)
+  as int16/int32 per axis, with o the minimum of the column.
+*/
+
+enum class PointEncoding : uint8_t { float64 = 0, float32 = 1, quantized16 = 2, quantized32 = 3 };
+
+struct PointCloud {
+  using Column = std::vector<double, boost::alignment::aligned_allocator<double, 64>>;
+
+  std::string reference;
+  Column x;
+  Column y;
+  Column z;
+  PointEncoding encoding = PointEncoding::float64;
+  double resolution = 1.0;  // Quantization step, only used by quantized encodings
+
+  size_t size() const { return x.size(); }
+  bool has_z() const { return !z.empty(); }
+
+  void reserve(size_t n) {
+    x.reserve(n);
+    y.reserve(n);
+    z.reserve(n);
+  }
+
+  void push_back(Point const& point) {
+    if (point.z && z.size() < x.size()) {
+      z.resize(x.size(), std::numeric_limits<double>::quiet_NaN());
+    }
+    x.push_back(point.x);
+    y.push_back(point.y);
+    if (has_z()) {
+      z.push_back(point.z ? *point.z : std::numeric_limits<double>::quiet_NaN());
+    }
+  }
+
+  Point at(size_t i) const {
+    Point point{x[i], y[i]};
+    if (has_z() && !std::isnan(z[i])) {
+      point.z = z[i];
+    }
+    return point;
+  }
+};
+
+inline PointCloud to_point_cloud(PointsWithReference const& points) {
+  PointCloud cloud;
+  cloud.reference = points.reference;
+  cloud.reserve(points.points.size());
+  for (auto&& point : points.points) {
+    cloud.push_back(point);
+  }
+  return cloud;
+}
+
+inline PointsWithReference to_points(PointCloud const& cloud) {
+  PointsWithReference points;
+  points.reference = cloud.reference;
+  points.points.reserve(cloud.size());
+  for (size_t i = 0; i < cloud.size(); ++i) {
+    points.points.push_back(cloud.at(i));
+  }
+  return points;
+}
+
+namespace detail {
+
+template <typename T>
+void store_le(T value, char* out) {
+  std::memcpy(out, &value, sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  std::reverse(out, out + sizeof(T));
+#endif
+}
+
+template <typename T>
+T load_le(const char* in) {
+  T value;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  char bytes[sizeof(T)];
+  std::reverse_copy(in, in + sizeof(T), bytes);
+  std::memcpy(&value, bytes, sizeof(T));
+#else
+  std::memcpy(&value, in, sizeof(T));
+#endif
+  return value;
+}
+
+inline size_t element_size(PointEncoding encoding) {
+  switch (encoding) {
+    case PointEncoding::float64: return 8;
+    case PointEncoding::float32: return 4;
+    case PointEncoding::quantized16: return 2;
+    case PointEncoding::quantized32: return 4;
+  }
+  throw msgpack::type_error();
+}
+
+inline bool is_quantized(PointEncoding encoding) {
+  return encoding == PointEncoding::quantized16 || encoding == PointEncoding::quantized32;
+}
+
+// Throws unless x and y hold 'size' points and z is empty or holds as many
+inline void check_columns(PointCloud const& cloud, size_t size) {
+  if (cloud.x.size() != size || cloud.y.size() != size || (cloud.has_z() && cloud.z.size() != size))
+    throw msgpack::type_error();
+}
+
+// Quantized encodings divide by the resolution
+inline void check_resolution(PointEncoding encoding, double resolution) {
+  if (is_quantized(encoding) && !(std::isfinite(resolution) && resolution > 0))
+    throw msgpack::type_error();
+}
+
+inline double column_offset(PointCloud::Column const& column) {
+  double offset = std::numeric_limits<double>::infinity();
+  for (auto value : column) {
+    offset = std::fmin(offset, value);  // fmin ignores NaN
+  }
+  return std::isfinite(offset) ? offset : 0.0;
+}
+
+// Quantized columns reserve the smallest integer to represent missing values
+template <typename Int>
+void quantize(PointCloud::Column const& column, double offset, double resolution, char* out) {
+  const auto nan = std::numeric_limits<Int>::min();
+  const double lo = std::numeric_limits<Int>::min() + 1;
+  const double hi = std::numeric_limits<Int>::max();
+  for (auto value : column) {
+    Int q = nan;
+    if (!std::isnan(value)) {
+      q = static_cast<Int>(std::fmax(lo, std::fmin(hi, std::round((value - offset) / resolution))));
+    }
+    store_le(q, out);
+    out += sizeof(Int);
+  }
+}
+
+template <typename Int>
+void dequantize(const char* in, double offset, double resolution, PointCloud::Column& column) {
+  const auto nan = std::numeric_limits<Int>::min();
+  for (auto& value : column) {
+    auto q = load_le<Int>(in);
+    value = q == nan ? std::numeric_limits<double>::quiet_NaN() : offset + q * resolution;
+    in += sizeof(Int);
+  }
+}
+
+inline void encode_column(PointCloud::Column const& column, PointEncoding encoding, double offset,
+                          double resolution, std::vector<char>& out) {
+  out.resize(column.size() * element_size(encoding));
+  auto ptr = out.data();
+  switch (encoding) {
+    case PointEncoding::float64:
+      for (auto value : column) {
+        store_le(value, ptr);
+        ptr += 8;
+      }
+      break;
+    case PointEncoding::float32:
+      for (auto value : column) {
+        store_le(static_cast<float>(value), ptr);
+        ptr += 4;
+      }
+      break;
+    case PointEncoding::quantized16: quantize<int16_t>(column, offset, resolution, ptr); break;
+    case PointEncoding::quantized32: quantize<int32_t>(column, offset, resolution, ptr); break;
+  }
+}
+
+inline void decode_column(const char* data, uint32_t bytes, size_t size, PointEncoding encoding,
+                          double offset, double resolution, PointCloud::Column& column) {
+  if (bytes == 0) {
+    column.clear();
+    return;
+  }
+  if (bytes != size * element_size(encoding)) {
+    throw msgpack::type_error();
+  }
+  column.resize(size);
+  switch (encoding) {
+    case PointEncoding::float64:
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      for (size_t i = 0; i < size; ++i) column[i] = load_le<double>(data + 8 * i);
+#else
+      std::memcpy(column.data(), data, bytes);
+#endif
+      break;
+    case PointEncoding::float32:
+      for (size_t i = 0; i < size; ++i) {
+        column[i] = load_le<float>(data + 4 * i);
+      }
+      break;
+    case PointEncoding::quantized16: dequantize<int16_t>(data, offset, resolution, column); break;
+    case PointEncoding::quantized32: dequantize<int32_t>(data, offset, resolution, column); break;
+  }
+}
+
+}  // ::detail
+
+}  // ::geometry
+}  // ::msg
+
+namespace codec {
+
+template <>
+struct Decoder<msg::geometry::PointCloud> {
+  void operator()(Reader& reader, msg::geometry::PointCloud& cloud) const {
+    using namespace msg::geometry;
+    if (reader.read_array() != 8) {
+      throw msgpack::type_error();
+    }
+    decode(reader, cloud.reference);
+    uint8_t encoding;
+    decode(reader, encoding);
+    cloud.encoding = static_cast<PointEncoding>(encoding);
+    uint32_t size;
+    decode(reader, size);
+    decode(reader, cloud.resolution);
+    detail::check_resolution(cloud.encoding, cloud.resolution);
+    std::vector<double> offsets;
+    decode(reader, offsets);
+    if (offsets.size() != 3) {
+      throw msgpack::type_error();
+    }
+
+    PointCloud::Column* columns[] = {&cloud.x, &cloud.y, &cloud.z};
+    for (int i = 0; i < 3; ++i) {
+      const char* data;
+      auto bytes = reader.read_raw(data);
+      detail::decode_column(data, bytes, size, cloud.encoding, offsets[i], cloud.resolution,
+                            *columns[i]);
+    }
+    detail::check_columns(cloud, size);
+  }
+};
+
+}  // ::codec
+}  // ::is
+
+namespace msgpack {
+
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+  namespace adaptor {
+
+  template <>
+  struct convert<is::msg::geometry::PointCloud> {
+    msgpack::object const& operator()(msgpack::object const& o,
+                                      is::msg::geometry::PointCloud& cloud) const {
+      using namespace is::msg::geometry;
+      if (o.type != msgpack::type::ARRAY || o.via.array.size != 8)
+        throw msgpack::type_error();
+
+      auto ptr = o.via.array.ptr;
+      cloud.reference = ptr[0].as<std::string>();
+      cloud.encoding = static_cast<PointEncoding>(ptr[1].as<uint8_t>());
+      auto size = ptr[2].as<uint32_t>();
+      cloud.resolution = ptr[3].as<double>();
+      is::msg::geometry::detail::check_resolution(cloud.encoding, cloud.resolution);
+      auto offsets = ptr[4].as<std::vector<double>>();
+      if (offsets.size() != 3)
+        throw msgpack::type_error();
+
+      PointCloud::Column* columns[] = {&cloud.x, &cloud.y, &cloud.z};
+      for (int i = 0; i < 3; ++i) {
+        auto&& column = ptr[5 + i];
+        if (column.type != msgpack::type::BIN)
+          throw msgpack::type_error();
+        is::msg::geometry::detail::decode_column(column.via.bin.ptr, column.via.bin.size, size,
+                                                 cloud.encoding, offsets[i], cloud.resolution,
+                                                 *columns[i]);
+      }
+      is::msg::geometry::detail::check_columns(cloud, size);
+      return o;
+    }
+  };
+
+  template <>
+  struct pack<is::msg::geometry::PointCloud> {
+    template <typename Stream>
+    packer<Stream>& operator()(msgpack::packer<Stream>& o,
+                               is::msg::geometry::PointCloud const& cloud) const {
+      using namespace is::msg::geometry;
+      is::msg::geometry::detail::check_columns(cloud, cloud.size());
+      is::msg::geometry::detail::check_resolution(cloud.encoding, cloud.resolution);
+      const bool quantized = is::msg::geometry::detail::is_quantized(cloud.encoding);
+      PointCloud::Column const* columns[] = {&cloud.x, &cloud.y, &cloud.z};
+      std::vector<double> offsets(3, 0.0);
+      if (quantized) {
+        for (int i = 0; i < 3; ++i) {
+          offsets[i] = is::msg::geometry::detail::column_offset(*columns[i]);
+        }
+      }
+
+      o.pack_array(8);
+      o.pack(cloud.reference);
+      o.pack(static_cast<uint8_t>(cloud.encoding));
+      o.pack(static_cast<uint32_t>(cloud.size()));
+      o.pack(cloud.resolution);
+      o.pack(offsets);
+
+      thread_local std::vector<char> scratch;
+      for (int i = 0; i < 3; ++i) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if (cloud.encoding == PointEncoding::float64) {
+          auto bytes = columns[i]->size() * sizeof(double);
+          o.pack_bin(bytes);
+          o.pack_bin_body(reinterpret_cast<const char*>(columns[i]->data()), bytes);
+          continue;
+        }
+#endif
+        is::msg::geometry::detail::encode_column(*columns[i], cloud.encoding, offsets[i],
+                                                 cloud.resolution, scratch);
+        o.pack_bin(scratch.size());
+        o.pack_bin_body(scratch.data(), scratch.size());
+      }
+      return o;
+    }
+  };
+
+  }  // ::adaptor
+
+}  // MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS)
+
+}  // ::msgpack
+
+#endif  // __IS_MSG_POINT_CLOUD_HPP__
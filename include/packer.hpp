@@ -5,11 +5,25 @@
 
 #include <SimpleAmqpClient/SimpleAmqpClient.h>
 #include <msgpack.hpp>
-#include <sstream>
 #include <string>
 #include <vector>
+#include "codec.hpp"
+#include "compression.hpp"
 
-#define IS_DEFINE_MSG MSGPACK_DEFINE_ARRAY
+/*
+  Besides the msgpack array adaptor, messages get a visitor over their fields
+  that the direct codec (see codec.hpp) uses to decode them in one pass.
+*/
+#define IS_DEFINE_MSG(...)                          \
+  MSGPACK_DEFINE_ARRAY(__VA_ARGS__)                 \
+  template <typename Visitor>                       \
+  void is_reflect(Visitor&& visitor) {              \
+    visitor(__VA_ARGS__);                           \
+  }                                                 \
+  template <typename Visitor>                       \
+  void is_reflect(Visitor&& visitor) const {        \
+    visitor(__VA_ARGS__);                           \
+  }
 
 /*
   Reference: https://github.com/msgpack/msgpack-c/wiki/v2_0_cpp_overview
@@ -21,23 +35,40 @@ using namespace AmqpClient;
 
 template <class T>
 std::string pack(T&& t) {
-  std::stringstream ss;
-  msgpack::pack(ss, std::forward<T>(t));
-  return ss.str();
+  return codec::encode(std::forward<T>(t));
 }
 
 template <class... Args>
 std::string pack(Args&&... args) {
-  std::stringstream ss;
-  msgpack::pack(ss, std::make_tuple(std::forward<Args>(args)...));
-  return ss.str();
+  return codec::encode(std::make_tuple(std::forward<Args>(args)...));
 }
 
 template <typename T>
 BasicMessage::ptr_t msgpack(T const& data) {
-  std::stringstream body;
-  msgpack::pack(body, data);
-  auto message = BasicMessage::Create(body.str());
+  auto message = BasicMessage::Create(codec::encode(data));
+  message->ContentEncoding("msgpack");
+  return message;
+}
+
+/*
+  Compresses the body with the policy codec when it is at least policy.threshold
+  bytes long and compression actually makes it smaller. The codec is signalled
+  as "msgpack+<codec>" in the ContentEncoding and undone by msgpack<T>(envelope).
+*/
+template <typename T>
+BasicMessage::ptr_t msgpack(T const& data, compression::Policy const& policy) {
+  auto body = codec::encode(data);
+  auto codec = policy.codec.empty() ? nullptr : compression::find(policy.codec);
+  if (codec != nullptr && body.size() >= policy.threshold) {
+    thread_local std::string compressed;
+    codec->compress(body.data(), body.size(), compressed);
+    if (compressed.size() < body.size()) {
+      auto message = BasicMessage::Create(compressed);
+      message->ContentEncoding("msgpack+" + codec->name());
+      return message;
+    }
+  }
+  auto message = BasicMessage::Create(body);
   message->ContentEncoding("msgpack");
   return message;
 }
@@ -45,12 +76,25 @@ BasicMessage::ptr_t msgpack(T const& data) {
 template <typename T>
 T msgpack(Envelope::ptr_t envelope) {
   auto message = envelope->Message();
-  auto body = message->Body();
-  msgpack::object_handle handle = msgpack::unpack(body.data(), body.size());
-  msgpack::object object = handle.get();
-  T data;
-  object.convert(data);
-  return data;
+  auto const& body = message->Body();
+
+  if (message->ContentEncodingIsSet()) {
+    auto const& encoding = message->ContentEncoding();
+    auto pos = encoding.find('+');
+    if (pos != std::string::npos) {
+      auto codec = encoding.compare(0, pos, "msgpack") == 0
+                       ? compression::find(encoding.substr(pos + 1))
+                       : nullptr;
+      if (codec == nullptr) {
+        throw std::runtime_error("Unsupported content encoding \"" + encoding + "\"");
+      }
+      thread_local std::string decompressed;
+      codec->decompress(body.data(), body.size(), decompressed);
+      return codec::decode<T>(decompressed.data(), decompressed.size());
+    }
+  }
+
+  return codec::decode<T>(body.data(), body.size());
 }
 
 }  // ::is
@@ -0,0 +1,232 @@
+#ifndef __IS_PRIORITY_LANES_HPP__
+#define __IS_PRIORITY_LANES_HPP__
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bounded-ring.hpp"
+#include "connection.hpp"
+#include "executor.hpp"
+#include "helpers.hpp"
+#include "logger.hpp"
+#include "topic-trie.hpp"
+
+namespace is {
+
+/*
+  Strict priority scheduler over lanes of envelopes, lane 0 first. Each lane
+  is a lock-free ring with a single producer (oldest envelopes are dropped
+  when full); consumers share one doorbell to sleep while all lanes are
+  empty.
+*/
+class LaneScheduler {
+  std::vector<std::unique_ptr<BoundedRing<Envelope::ptr_t>>> lanes;
+  Doorbell doorbell;
+
+  bool any() const {
+    for (auto&& lane : lanes) {
+      if (lane->size() > 0)
+        return true;
+    }
+    return false;
+  }
+
+ public:
+  LaneScheduler(size_t n_lanes, size_t capacity = 256) {
+    for (size_t i = 0; i < n_lanes; ++i) {
+      lanes.emplace_back(new BoundedRing<Envelope::ptr_t>(capacity));
+    }
+  }
+
+  size_t size() const { return lanes.size(); }
+
+  // Approximate number of envelopes waiting in the lane
+  size_t pending(size_t lane) const { return lanes[lane]->size(); }
+
+  // Envelopes dropped because the consumer fell behind
+  uint64_t dropped(size_t lane) const { return lanes[lane]->dropped(); }
+
+  // One producer thread per lane
+  void push(size_t lane, Envelope::ptr_t envelope) {
+    lanes[lane]->push_overwrite(std::move(envelope));
+    doorbell.ring();
+  }
+
+  // Envelope of the highest priority non empty lane, false if all are empty
+  bool try_pop(Envelope::ptr_t& envelope) {
+    for (auto&& lane : lanes) {
+      if (lane->try_pop(envelope))
+        return true;
+    }
+    return false;
+  }
+
+  template <typename Time>
+  bool pop_for(Envelope::ptr_t& envelope, Time const& timeout) {
+    if (try_pop(envelope))
+      return true;
+    doorbell.wait_for(timeout, [this]() { return any(); });
+    return try_pop(envelope);
+  }
+
+  Envelope::ptr_t pop() {
+    Envelope::ptr_t envelope;
+    while (!pop_for(envelope, milliseconds(100))) {
+    }
+    return envelope;
+  }
+};  // ::LaneScheduler
+
+struct Lane {
+  std::string name;
+  std::vector<std::string> topics;  // Patterns whose traffic goes through this lane
+  uint8_t priority = 0;             // AMQP priority set on published messages, 0 leaves it unset
+};
+
+/*
+  Separates traffic classes (e.g. control commands and bulk video) into lanes,
+  each with its own broker connections, so small messages never wait behind
+  large ones in the same TCP stream. Lanes are given in decreasing priority
+  and topics matching none of the patterns go through the last lane.
+  Subscriptions are consumed by one thread per lane and consume() always
+  serves the highest priority lane with pending messages first.
+
+    PriorityLanes lanes(uri, {{"control", {"robot.*.speed"}, 9}, {"bulk", {"#"}}});
+    lanes.publish("robot.0.speed", is::msgpack(speed));   // control connection
+    lanes.publish("webcam.frame", is::msgpack(packet));   // bulk connection
+
+  Publishing is thread safe across lanes, but each lane must only be used by
+  one thread at a time.
+*/
+class PriorityLanes {
+  struct State {
+    Lane lane;
+    Connection publisher;
+    std::unique_ptr<Connection> subscriber;  // Own channel, used by the lane thread
+    std::unique_ptr<QueueInfo> queue;
+    std::thread thread;
+  };
+
+  const std::string uri;
+  Executor& executor;
+  std::vector<std::unique_ptr<State>> lanes;
+  TopicTrie<size_t> routes;
+  LaneScheduler scheduler;
+  std::atomic<bool> running{true};
+
+  void consume_lane(size_t index) {
+    auto&& state = *lanes[index];
+    try {
+      while (running) {
+        auto envelope = state.subscriber->consume_for(*state.queue, milliseconds(100));
+        if (envelope != nullptr) {
+          scheduler.push(index, std::move(envelope));
+        }
+      }
+    } catch (std::exception const& e) {
+      log::error("Lane \"{}\" stopped consuming \n\t@reason: \"{}\"", state.lane.name, e.what());
+    }
+  }
+
+ public:
+  // Lane threads come from the "network" pool of the executor
+  PriorityLanes(std::string const& uri, std::vector<Lane> const& config, size_t capacity = 256,
+                Executor& executor = is::executor())
+      : uri(uri), executor(executor), scheduler(config.size(), capacity) {
+    if (config.empty()) {
+      throw std::invalid_argument("At least one lane is required");
+    }
+    for (size_t i = 0; i < config.size(); ++i) {
+      lanes.emplace_back(new State{config[i], Connection(make_channel(uri)), nullptr, nullptr, {}});
+      for (auto&& topic : config[i].topics) {
+        routes.insert(topic, i);
+      }
+    }
+  }
+
+  ~PriorityLanes() {
+    running = false;
+    for (auto&& state : lanes) {
+      if (state->thread.joinable()) {
+        state->thread.join();
+        state->subscriber->unsubscribe(*state->queue);
+      }
+    }
+  }
+
+  PriorityLanes(PriorityLanes const&) = delete;
+  PriorityLanes& operator=(PriorityLanes const&) = delete;
+
+  size_t lane_of(std::string const& topic) const {
+    auto lane = routes.find(topic);
+    return lane != nullptr ? *lane : lanes.size() - 1;
+  }
+
+  Lane const& lane(size_t index) const { return lanes[index]->lane; }
+
+  // Sets the lane priority (and the timestamp, see Connection::publish) on 'message' itself
+  bool publish(std::string const& topic, BasicMessage::ptr_t message,
+               std::string const& exchange = "data") {
+    auto&& state = *lanes[lane_of(topic)];
+    if (state.lane.priority > 0) {
+      message->Priority(state.lane.priority);
+    }
+    return state.publisher.publish(topic, message, exchange);
+  }
+
+  /*
+    Subscribes to the topics, each through the lane its pattern routes to.
+    Lanes with a priority declare their queue with x-max-priority, so the
+    broker orders it by message priority. Throws std::logic_error if a lane
+    is already subscribed: its queue is bound to the lane's channel, which
+    the lane thread is using.
+  */
+  void subscribe(std::vector<std::string> const& topics, std::string const& exchange = "data",
+                 int queue_size = 32) {
+    std::vector<std::vector<std::string>> by_lane(lanes.size());
+    for (auto&& topic : topics) {
+      by_lane[lane_of(topic)].push_back(topic);
+    }
+    for (size_t i = 0; i < lanes.size(); ++i) {
+      if (!by_lane[i].empty() && lanes[i]->thread.joinable()) {
+        throw std::logic_error("Lane \"" + lanes[i]->lane.name + "\" is already subscribed");
+      }
+    }
+    for (size_t i = 0; i < lanes.size(); ++i) {
+      auto&& state = *lanes[i];
+      if (by_lane[i].empty())
+        continue;
+      Table arguments;
+      if (state.lane.priority > 0) {
+        auto priority = static_cast<int32_t>(state.lane.priority);
+        arguments[TableKey("x-max-priority")] = TableValue(priority);
+      }
+      state.subscriber.reset(new Connection(make_channel(uri)));
+      auto queue = state.subscriber->subscribe(by_lane[i], exchange, queue_size, arguments);
+      state.queue.reset(new QueueInfo(queue));
+      state.thread = executor.spawn("network", [this, i]() { consume_lane(i); });
+    }
+  }
+
+  // Next message of the highest priority lane with messages waiting
+  Envelope::ptr_t consume() { return scheduler.pop(); }
+
+  template <typename Time>
+  Envelope::ptr_t consume_for(Time const& timeout) {
+    Envelope::ptr_t envelope;
+    scheduler.pop_for(envelope, timeout);
+    return envelope;
+  }
+
+  // Messages dropped in the lane because consume() fell behind
+  uint64_t dropped(size_t lane) const { return scheduler.dropped(lane); }
+};  // ::PriorityLanes
+
+}  // ::is
+
+#endif  // __IS_PRIORITY_LANES_HPP__
@@ -0,0 +1,559 @@
+#ifndef __IS_RECORDING_HPP__
+#define __IS_RECORDING_HPP__
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "codec.hpp"
+#include "connection.hpp"
+#include "logger.hpp"
+
+/*
+  Recording of bus traffic for later replay (load tests, debugging).
+
+  A recording is a directory of segments, each one an append-only log file
+  "<n>.log" and a time index "<n>.idx". The log starts with the 8 byte magic
+  "ISREC001" followed by records, all integers little endian:
+
+    u32 size (of the rest of the record)
+    u64 arrival time [ns since epoch]      u64 message timestamp [ns, 0 if unset]
+    u16 routing key size                   u16 content encoding size
+    u32 headers size                       u32 body size
+    routing key, content encoding, headers (msgpack map), body
+
+  The index holds one fixed size entry per record, {u64 arrival, u64 offset},
+  so both files can be memory mapped and searched by time in O(log n). A new
+  segment is started once the current log exceeds the segment size. Index
+  entries pointing past the end of the log (a crash, a full disk) are dropped
+  when reading.
+*/
+
+namespace is {
+namespace recording {
+
+using namespace std::chrono;
+
+namespace detail {
+
+constexpr char magic[] = "ISREC001";
+constexpr size_t magic_size = 8;
+constexpr size_t record_header_size = 32;
+constexpr size_t index_entry_size = 16;
+
+template <typename T>
+void put(char* out, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    out[i] = static_cast<char>(static_cast<uint64_t>(value) >> (8 * i));
+  }
+}
+
+template <typename T>
+T get(const char* in) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+  }
+  return static_cast<T>(value);
+}
+
+inline std::string segment_path(std::string const& directory, unsigned segment,
+                                const char* extension) {
+  char name[32];
+  std::snprintf(name, sizeof name, "/%08u.%s", segment, extension);
+  return directory + name;
+}
+
+// Segment numbers present in the directory, sorted
+inline std::vector<unsigned> list_segments(std::string const& directory) {
+  std::vector<unsigned> segments;
+  auto dir = opendir(directory.c_str());
+  if (dir == nullptr)
+    return segments;
+  while (auto entry = readdir(dir)) {
+    unsigned segment;
+    char extension[4];
+    if (std::sscanf(entry->d_name, "%8u.%3s", &segment, extension) == 2 &&
+        std::strcmp(extension, "idx") == 0) {
+      segments.push_back(segment);
+    }
+  }
+  closedir(dir);
+  std::sort(segments.begin(), segments.end());
+  return segments;
+}
+
+// Only scalar and string header values are kept
+inline bool is_kept(TableValue const& value) {
+  switch (value.GetType()) {
+    case TableValue::VT_bool:
+    case TableValue::VT_int8:
+    case TableValue::VT_int16:
+    case TableValue::VT_int32:
+    case TableValue::VT_int64:
+    case TableValue::VT_float:
+    case TableValue::VT_double:
+    case TableValue::VT_string: return true;
+    default: return false;
+  }
+}
+
+inline void pack_headers(BasicMessage::ptr_t const& message, std::string& out) {
+  if (!message->HeaderTableIsSet())
+    return;
+  auto const& headers = message->HeaderTable();
+  auto n = std::count_if(headers.begin(), headers.end(),
+                         [](auto&& header) { return is_kept(header.second); });
+
+  codec::StringBuffer buffer{out};
+  msgpack::packer<codec::StringBuffer> packer(buffer);
+  packer.pack_map(n);
+  for (auto&& header : headers) {
+    auto&& value = header.second;
+    if (!is_kept(value))
+      continue;
+    packer.pack(header.first);
+    switch (value.GetType()) {
+      case TableValue::VT_bool: packer.pack(value.GetBool()); break;
+      case TableValue::VT_int8: packer.pack(value.GetInt8()); break;
+      case TableValue::VT_int16: packer.pack(value.GetInt16()); break;
+      case TableValue::VT_int32: packer.pack(value.GetInt32()); break;
+      case TableValue::VT_int64: packer.pack(value.GetInt64()); break;
+      case TableValue::VT_float: packer.pack(value.GetFloat()); break;
+      case TableValue::VT_double: packer.pack(value.GetDouble()); break;
+      default: packer.pack(value.GetString()); break;
+    }
+  }
+}
+
+inline Table unpack_headers(const char* data, size_t size) {
+  Table headers;
+  if (size == 0)
+    return headers;
+  codec::Reader reader(data, size);
+  auto n = reader.read_map();
+  for (uint32_t i = 0; i < n; ++i) {
+    std::string key;
+    codec::decode(reader, key);
+    auto tag = reader.peek();
+    if (tag == 0xc2 || tag == 0xc3) {
+      headers[key] = TableValue(reader.read_bool());
+    } else if (tag == 0xca || tag == 0xcb) {
+      headers[key] = TableValue(reader.read_float());
+    } else if ((tag & 0xe0) == 0xa0 || (tag >= 0xd9 && tag <= 0xdb)) {
+      std::string value;
+      codec::decode(reader, value);
+      headers[key] = TableValue(value);
+    } else {
+      int64_t value;
+      codec::decode(reader, value);
+      headers[key] = TableValue(value);
+    }
+  }
+  return headers;
+}
+
+}  // ::detail
+
+struct View {
+  const char* data = nullptr;
+  size_t size = 0;
+
+  std::string str() const { return std::string(data, size); }
+};
+
+// Points into the mapped segment, valid while the Reader is alive
+struct Record {
+  uint64_t arrival;    // [ns since epoch]
+  uint64_t timestamp;  // Message timestamp [ns], 0 if unset
+  View routing_key;
+  View content_encoding;
+  View headers;  // msgpack map
+  View body;
+
+  BasicMessage::ptr_t message() const {
+    auto message = BasicMessage::Create(body.str());
+    if (content_encoding.size) {
+      message->ContentEncoding(content_encoding.str());
+    }
+    if (headers.size) {
+      message->HeaderTable(detail::unpack_headers(headers.data, headers.size));
+    }
+    if (timestamp) {
+      message->Timestamp(timestamp);
+    }
+    return message;
+  }
+};
+
+class Writer {
+  const std::string directory;
+  const size_t max_segment_bytes;
+
+  FILE* log = nullptr;
+  FILE* index = nullptr;
+  unsigned segment;
+  uint64_t offset;
+  // Reused, so appending does not allocate once warm (except for string header values)
+  std::string headers;
+
+  [[noreturn]] void fail() {
+    throw std::runtime_error("Failed to write to \"" + directory + "\": " + std::strerror(errno));
+  }
+
+  void write(const void* data, size_t size, FILE* file) {
+    if (size > 0 && std::fwrite(data, 1, size, file) != size)
+      fail();
+  }
+
+  void open_segment() {
+    if (log != nullptr) {
+      flush();
+    }
+    close();
+    log = std::fopen(detail::segment_path(directory, segment, "log").c_str(), "wb");
+    index = std::fopen(detail::segment_path(directory, segment, "idx").c_str(), "wb");
+    if (log == nullptr || index == nullptr)
+      throw std::runtime_error("Failed to create segment in \"" + directory + "\"");
+    std::setvbuf(log, nullptr, _IOFBF, 1 << 20);
+    write(detail::magic, detail::magic_size, log);
+    offset = detail::magic_size;
+  }
+
+  // The log is closed first so the index never gets ahead of it
+  void close() {
+    bool failed = false;
+    if (log != nullptr)
+      failed |= std::fclose(log) != 0;
+    if (index != nullptr)
+      failed |= std::fclose(index) != 0;
+    log = index = nullptr;
+    if (failed) {
+      log::error("Failed to close segment {} of \"{}\", the recording may be truncated",
+                 segment, directory);
+    }
+  }
+
+ public:
+  Writer(std::string const& directory, size_t max_segment_bytes = 256 << 20)
+      : directory(directory), max_segment_bytes(max_segment_bytes) {
+    ::mkdir(directory.c_str(), 0755);
+    auto segments = detail::list_segments(directory);
+    segment = segments.empty() ? 0 : segments.back() + 1;
+    open_segment();
+  }
+
+  ~Writer() { close(); }
+
+  Writer(Writer const&) = delete;
+  Writer& operator=(Writer const&) = delete;
+
+  void append(Envelope::ptr_t const& envelope,
+              uint64_t arrival = system_clock::now().time_since_epoch().count()) {
+    auto&& message = envelope->Message();
+    auto&& routing_key = envelope->RoutingKey();
+    static const std::string none;
+    auto const& encoding = message->ContentEncodingIsSet() ? message->ContentEncoding() : none;
+    auto&& body = message->Body();
+    headers.clear();
+    detail::pack_headers(message, headers);
+
+    auto size = detail::record_header_size + routing_key.size() + encoding.size() +
+                headers.size() + body.size();
+    char header[detail::record_header_size];
+    detail::put<uint32_t>(header, size - 4);
+    detail::put<uint64_t>(header + 4, arrival);
+    detail::put<uint64_t>(header + 12, message->TimestampIsSet() ? message->Timestamp() : 0);
+    detail::put<uint16_t>(header + 20, routing_key.size());
+    detail::put<uint16_t>(header + 22, encoding.size());
+    detail::put<uint32_t>(header + 24, headers.size());
+    detail::put<uint32_t>(header + 28, body.size());
+
+    // Throws on a full disk, whatever was buffered is dropped by the reader (see above)
+    write(header, sizeof header, log);
+    write(routing_key.data(), routing_key.size(), log);
+    write(encoding.data(), encoding.size(), log);
+    write(headers.data(), headers.size(), log);
+    write(body.data(), body.size(), log);
+
+    char entry[detail::index_entry_size];
+    detail::put<uint64_t>(entry, arrival);
+    detail::put<uint64_t>(entry + 8, offset);
+    write(entry, sizeof entry, index);
+
+    offset += size;
+    if (offset >= max_segment_bytes) {
+      ++segment;
+      open_segment();
+    }
+  }
+
+  void flush() {
+    if (std::fflush(log) != 0 || std::fflush(index) != 0)
+      fail();
+  }
+};  // ::Writer
+
+class Reader {
+  struct Segment {
+    const char* log;
+    size_t log_size;
+    const char* index;
+    size_t index_size;
+    size_t entries;
+  };
+
+  std::vector<Segment> segments;
+  std::vector<size_t> filled;  // Segments with records, seek() skips the others
+  size_t segment = 0;          // Cursor
+  size_t entry = 0;
+
+  static const char* map(std::string const& path, size_t& size) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("Failed to open \"" + path + "\"");
+    struct stat info;
+    ::fstat(fd, &info);
+    size = info.st_size;
+    void* data = nullptr;
+    if (size > 0) {
+      data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED)
+      throw std::runtime_error("Failed to map \"" + path + "\"");
+    return static_cast<const char*>(data);
+  }
+
+  uint64_t arrival(Segment const& s, size_t i) const {
+    return detail::get<uint64_t>(s.index + i * detail::index_entry_size);
+  }
+
+  // Whether the i-th record is entirely within the log
+  bool complete(Segment const& s, size_t i) const {
+    auto offset = detail::get<uint64_t>(s.index + i * detail::index_entry_size + 8);
+    return offset + detail::record_header_size <= s.log_size &&
+           offset + detail::get<uint32_t>(s.log + offset) + 4 <= s.log_size;
+  }
+
+ public:
+  Reader(std::string const& directory) {
+    for (auto n : detail::list_segments(directory)) {
+      Segment s;
+      s.index = map(detail::segment_path(directory, n, "idx"), s.index_size);
+      s.log = map(detail::segment_path(directory, n, "log"), s.log_size);
+      s.entries = s.index_size / detail::index_entry_size;
+      if (s.log_size < detail::magic_size ||
+          std::memcmp(s.log, detail::magic, detail::magic_size) != 0) {
+        log::warn("Skipping invalid segment {} of \"{}\"", n, directory);
+        s.entries = 0;
+      }
+      auto indexed = s.entries;
+      while (s.entries > 0 && !complete(s, s.entries - 1)) {
+        --s.entries;
+      }
+      if (s.entries < indexed) {
+        log::warn("Dropping {} truncated records of segment {} of \"{}\"", indexed - s.entries,
+                  n, directory);
+      }
+      if (s.entries > 0) {
+        filled.push_back(segments.size());
+      }
+      segments.push_back(s);
+    }
+  }
+
+  ~Reader() {
+    for (auto&& s : segments) {
+      if (s.index != nullptr)
+        ::munmap(const_cast<char*>(s.index), s.index_size);
+      if (s.log != nullptr)
+        ::munmap(const_cast<char*>(s.log), s.log_size);
+    }
+  }
+
+  Reader(Reader const&) = delete;
+  Reader& operator=(Reader const&) = delete;
+
+  size_t size() const {
+    size_t n = 0;
+    for (auto&& s : segments) n += s.entries;
+    return n;
+  }
+
+  // Arrival time of the first and last records, 0 if empty
+  uint64_t begin_time() const {
+    for (auto&& s : segments) {
+      if (s.entries)
+        return arrival(s, 0);
+    }
+    return 0;
+  }
+
+  uint64_t end_time() const {
+    for (auto s = segments.rbegin(); s != segments.rend(); ++s) {
+      if (s->entries)
+        return arrival(*s, s->entries - 1);
+    }
+    return 0;
+  }
+
+  // Positions the cursor at the first record that arrived at or after 'time'
+  void seek(uint64_t time) {
+    // Last segment with records starting at or before 'time', segments are in arrival order
+    auto starts_after = [this](uint64_t t, size_t i) { return t < arrival(segments[i], 0); };
+    auto after = std::upper_bound(filled.begin(), filled.end(), time, starts_after);
+    segment = after != filled.begin() ? *(after - 1) : 0;
+    entry = 0;
+    if (segment >= segments.size())
+      return;
+
+    auto&& s = segments[segment];
+    size_t first = 0, last = s.entries;
+    while (first < last) {
+      auto mid = (first + last) / 2;
+      if (arrival(s, mid) < time) {
+        first = mid + 1;
+      } else {
+        last = mid;
+      }
+    }
+    entry = first;
+  }
+
+  // Returns false once every record was read
+  bool next(Record& record) {
+    while (segment < segments.size() && entry >= segments[segment].entries) {
+      ++segment;
+      entry = 0;
+    }
+    if (segment >= segments.size())
+      return false;
+
+    auto&& s = segments[segment];
+    auto offset = detail::get<uint64_t>(s.index + entry * detail::index_entry_size + 8);
+    ++entry;
+    if (offset + detail::record_header_size > s.log_size)
+      throw std::runtime_error("Truncated recording");
+
+    auto data = s.log + offset;
+    auto size = detail::get<uint32_t>(data) + 4;
+    if (offset + size > s.log_size)
+      throw std::runtime_error("Truncated recording");
+
+    record.arrival = detail::get<uint64_t>(data + 4);
+    record.timestamp = detail::get<uint64_t>(data + 12);
+    record.routing_key.size = detail::get<uint16_t>(data + 20);
+    record.content_encoding.size = detail::get<uint16_t>(data + 22);
+    record.headers.size = detail::get<uint32_t>(data + 24);
+    record.body.size = detail::get<uint32_t>(data + 28);
+    record.routing_key.data = data + detail::record_header_size;
+    record.content_encoding.data = record.routing_key.data + record.routing_key.size;
+    record.headers.data = record.content_encoding.data + record.content_encoding.size;
+    record.body.data = record.headers.data + record.headers.size;
+    return true;
+  }
+};  // ::Reader
+
+/*
+  Subscribes to the given topic patterns and appends every message received
+  to a recording.
+*/
+class Recorder {
+  Connection is;
+  QueueInfo queue;
+  Writer writer;
+
+ public:
+  Recorder(Connection connection, std::string const& directory,
+           std::vector<std::string> const& topics, std::string const& exchange = "data",
+           int queue_size = 4096, size_t max_segment_bytes = 256 << 20)
+      : is(connection),
+        queue(is.subscribe(topics, exchange, queue_size)),
+        writer(directory, max_segment_bytes) {}
+
+  ~Recorder() { is.unsubscribe(queue); }
+
+  // Returns the number of messages recorded
+  template <typename Time>
+  size_t record_for(Time const& duration) {
+    auto deadline = steady_clock::now() + duration;
+    size_t n = 0;
+    while (1) {
+      auto left = duration_cast<milliseconds>(deadline - steady_clock::now());
+      if (left.count() <= 0)
+        break;
+      auto envelope = is.consume_for(queue, left);
+      if (envelope != nullptr) {
+        writer.append(envelope);
+        ++n;
+      }
+    }
+    writer.flush();
+    return n;
+  }
+};  // ::Recorder
+
+/*
+  Republishes a recording through Connection::publish, keeping the original
+  inter-arrival times scaled by 1/speed (speed 0 replays as fast as
+  possible). Messages are stamped at replay time unless keep_timestamps.
+*/
+class Replayer {
+  Reader reader;
+
+ public:
+  Replayer(std::string const& directory) : reader(directory) {}
+
+  Reader& records() { return reader; }
+
+  // Replays the records that arrived in [from, to], returns how many
+  size_t replay(Connection& is, double speed = 1.0, uint64_t from = 0,
+                uint64_t to = std::numeric_limits<uint64_t>::max(),
+                std::string const& exchange = "data", bool keep_timestamps = false) {
+    reader.seek(from);
+    auto start = steady_clock::now();
+    int64_t first = 0;
+    int64_t elapsed = 0;  // Since the first record, never going back [ns]
+    size_t n = 0;
+
+    Record record;
+    while (reader.next(record) && record.arrival <= to) {
+      auto arrival = static_cast<int64_t>(record.arrival);
+      if (n == 0) {
+        first = arrival;
+      }
+      // Records stamped before a wall clock step back follow the previous one without a pause
+      elapsed = std::max(elapsed, arrival - first);
+      if (speed > 0.0) {
+        auto offset = nanoseconds(static_cast<int64_t>(elapsed / speed));
+        std::this_thread::sleep_until(start + offset);
+      }
+
+      auto message = record.message();
+      if (!keep_timestamps) {
+        message->TimestampClear();
+      }
+      is.publish(record.routing_key.str(), message, exchange);
+      ++n;
+    }
+    return n;
+  }
+};  // ::Replayer
+
+}  // ::recording
+}  // ::is
+
+#endif  // __IS_RECORDING_HPP__
@@ -0,0 +1,91 @@
+#ifndef __IS_REPLY_CACHE_HPP__
+#define __IS_REPLY_CACHE_HPP__
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+namespace is {
+
+using namespace AmqpClient;
+using namespace std::chrono;
+
+struct CachePolicy {
+  milliseconds ttl{0};  // Zero keeps the reply until invalidated
+};
+
+// Copy of the message without its correlation properties, which requests set on replies
+inline BasicMessage::ptr_t copy_reply(BasicMessage const& message) {
+  auto copy = BasicMessage::Create(message.Body());
+  if (message.ContentTypeIsSet())
+    copy->ContentType(message.ContentType());
+  if (message.ContentEncodingIsSet())
+    copy->ContentEncoding(message.ContentEncoding());
+  if (message.DeliveryModeIsSet())
+    copy->DeliveryMode(message.DeliveryMode());
+  if (message.PriorityIsSet())
+    copy->Priority(message.Priority());
+  if (message.ExpirationIsSet())
+    copy->Expiration(message.Expiration());
+  if (message.MessageIdIsSet())
+    copy->MessageId(message.MessageId());
+  if (message.TimestampIsSet())
+    copy->Timestamp(message.Timestamp());
+  if (message.TypeIsSet())
+    copy->Type(message.Type());
+  if (message.UserIdIsSet())
+    copy->UserId(message.UserId());
+  if (message.AppIdIsSet())
+    copy->AppId(message.AppId());
+  if (message.HeaderTableIsSet())
+    copy->HeaderTable(message.HeaderTable());
+  return copy;
+}
+
+/*
+  Caches the reply of an idempotent service. The serialized reply is kept as
+  an immutable snapshot that is replaced atomically, so hits neither run the
+  service nor serialize it again: each hit answers a copy of the cached
+  message, which the dispatcher then stamps with the request correlation
+  properties. Can be used from any number of threads.
+*/
+class ReplyCache {
+  struct Entry {
+    BasicMessage::ptr_t reply;
+    uint64_t version;
+    steady_clock::time_point expiration;
+  };
+
+  std::function<BasicMessage::ptr_t(Envelope::ptr_t)> service;
+  const CachePolicy policy;
+  std::atomic<uint64_t> version;
+  std::shared_ptr<const Entry> entry;  // Accessed with std::atomic_load/store
+
+ public:
+  ReplyCache(std::function<BasicMessage::ptr_t(Envelope::ptr_t)> service,
+             CachePolicy const& policy = CachePolicy())
+      : service(service), policy(policy), version(0) {}
+
+  BasicMessage::ptr_t operator()(Envelope::ptr_t const& request) {
+    auto now = steady_clock::now();
+    auto cached = std::atomic_load(&entry);
+    if (cached == nullptr || cached->version != version.load() || cached->expiration <= now) {
+      // Read the version first so an invalidation during the call is not lost
+      auto current = version.load();
+      auto expiration =
+          policy.ttl.count() > 0 ? now + policy.ttl : steady_clock::time_point::max();
+      cached = std::make_shared<const Entry>(Entry{service(request), current, expiration});
+      std::atomic_store(&entry, cached);
+    }
+
+    return copy_reply(*cached->reply);
+  }
+
+  void invalidate() { ++version; }
+};  // ::ReplyCache
+
+}  // ::is
+
+#endif  // __IS_REPLY_CACHE_HPP__
@@ -2,7 +2,10 @@
 #define __IS_SERVICE_CLIENT_HPP__
 
 #include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
+#include "helpers.hpp"
 #include "logger.hpp"
 
 namespace is {
@@ -11,11 +14,20 @@ using namespace AmqpClient;
 using namespace std::chrono;
 
 struct discard_others_tag {};
+struct keep_others_tag {};
 
 namespace policy {
 const auto discard_others = discard_others_tag{};
+// Replies to other requests are kept and returned when they are waited for
+const auto keep_others = keep_others_tag{};
 }
 
+// Result of a scatter-gather request
+struct Gather {
+  std::unordered_map<std::string, Envelope::ptr_t> replies;  // route -> reply
+  std::vector<std::string> stragglers;  // routes that did not reply in time
+};
+
 class ServiceClient {
   Channel::ptr_t channel;
   const std::string exchange;
@@ -24,9 +36,35 @@ class ServiceClient {
   std::string rpc_queue;
   std::string rpc_tag;
 
+  // Replies received while waiting for others, bounded to the newest max_kept
+  std::unordered_map<std::string, Envelope::ptr_t> kept;
+  std::deque<std::string> kept_order;
+  const size_t max_kept;
+
+  void keep(Envelope::ptr_t const& envelope) {
+    auto id = envelope->Message()->CorrelationId();
+    if (kept.emplace(id, envelope).second) {
+      kept_order.push_back(id);
+    }
+    while (kept_order.size() > max_kept) {
+      kept.erase(kept_order.front());
+      kept_order.pop_front();
+    }
+  }
+
+  Envelope::ptr_t take(std::string const& id) {
+    auto envelope = kept.find(id);
+    if (envelope == kept.end())
+      return nullptr;
+    auto reply = envelope->second;
+    kept.erase(envelope);
+    return reply;
+  }
+
  public:
-  ServiceClient(Channel::ptr_t channel, std::string const& exchange = "services")
-      : channel(channel), exchange(exchange), correlation_id(0) {
+  ServiceClient(Channel::ptr_t channel, std::string const& exchange = "services",
+                size_t max_kept = 1024)
+      : channel(channel), exchange(exchange), correlation_id(0), max_kept(max_kept) {
     // passive durable auto_delete
     channel->DeclareExchange(exchange, Channel::EXCHANGE_TYPE_TOPIC, false, false, false);
     // queue_name, passive, durable, exclusive, auto_delete
@@ -53,13 +91,20 @@ class ServiceClient {
         message->ReplyTo(route.substr(pos + 1) + ';' + rpc_queue);
         channel->BasicPublish(exchange, route.substr(0, pos), message, mandatory);
       }
-    } catch (MessageReturnedException) {
+    } catch (MessageReturnedException const&) {
       log::warn("No route for {}", route);
     }
 
     return id;
   }
 
+  // Providers drop the request without calling the service once 'deadline' passed
+  std::string request(std::string const& route, BasicMessage::ptr_t message,
+                      system_clock::time_point const& deadline) {
+    set_deadline(message, deadline);
+    return request(route, message);
+  }
+
   template <typename Time>
   auto receive_for(Time const& timeout) {
     int timeout_ms = duration_cast<milliseconds>(timeout).count();
@@ -68,12 +113,30 @@ class ServiceClient {
     return envelope;
   }
 
+  // Replies already received, up to 'max_n', waiting at most 'timeout' for the first one
+  template <typename Time>
+  size_t receive_batch_for(Time const& timeout, std::vector<Envelope::ptr_t>& batch,
+                           size_t max_n) {
+    int timeout_ms = duration_cast<milliseconds>(timeout).count();
+    return consume_batch(channel, rpc_tag, batch, max_n, timeout_ms);
+  }
+
+  template <typename Time>
+  size_t receive_batch_until(Time const& deadline, std::vector<Envelope::ptr_t>& batch,
+                             size_t max_n) {
+    auto timeout = duration_cast<milliseconds>(deadline - system_clock::now());
+    return receive_batch_for(std::max(timeout, milliseconds(0)), batch, max_n);
+  }
+
   template <typename Time>
   auto receive_for(Time const& timeout, std::string const& id, discard_others_tag) {
-    Envelope::ptr_t envelope;
-    do {
+    auto envelope = take(id);
+    while (envelope == nullptr) {
       envelope = receive_for(timeout);
-    } while (envelope != nullptr && envelope->Message()->CorrelationId() != id);
+      if (envelope == nullptr || envelope->Message()->CorrelationId() == id)
+        break;
+      envelope = nullptr;
+    }
     return envelope;
   }
 
@@ -89,30 +152,111 @@ class ServiceClient {
 
   template <typename Time>
   auto receive_until(Time const& deadline, std::string const& id, discard_others_tag) {
-    Envelope::ptr_t envelope;
-    do {
+    auto envelope = take(id);
+    while (envelope == nullptr) {
       envelope = receive_until(deadline);
-    } while (envelope != nullptr && envelope->Message()->CorrelationId() != id);
+      if (envelope == nullptr || envelope->Message()->CorrelationId() == id)
+        break;
+      envelope = nullptr;
+    }
+    return envelope;
+  }
+
+  template <typename Time>
+  auto receive_until(Time const& deadline, std::string const& id, keep_others_tag) {
+    auto envelope = take(id);
+    while (envelope == nullptr) {
+      envelope = receive_until(deadline);
+      if (envelope == nullptr || envelope->Message()->CorrelationId() == id)
+        break;
+      keep(envelope);
+      envelope = nullptr;
+    }
     return envelope;
   }
 
   template <typename Time>
   auto receive_until(Time const& deadline, std::vector<std::string> const& ids,
                      discard_others_tag) {
+    return receive_until(deadline, ids, ids.size(), false);
+  }
+
+  template <typename Time>
+  auto receive_until(Time const& deadline, std::vector<std::string> const& ids, keep_others_tag) {
+    return receive_until(deadline, ids, ids.size(), true);
+  }
+
+  /*
+    Sends the same request to every route and collects the replies until all of
+    them arrived, 'quorum' of them arrived (0 means all) or the deadline
+    expired. Routes without reply are reported as stragglers, late replies to
+    them are kept like with policy::keep_others. The requests carry the
+    deadline, so providers skip them once it passed.
+  */
+  template <typename Time>
+  Gather gather_until(Time const& deadline, std::vector<std::string> const& routes,
+                      BasicMessage::ptr_t message, size_t quorum = 0) {
+    set_deadline(message, deadline);
+    std::vector<std::string> ids;
+    ids.reserve(routes.size());
+    for (auto& route : routes) {
+      ids.push_back(request(route, message));
+    }
+    if (quorum == 0 || quorum > routes.size()) {
+      quorum = routes.size();
+    }
+
+    auto replies = receive_until(deadline, ids, quorum, true);
+
+    Gather gather;
+    gather.replies.reserve(replies.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+      auto reply = replies.find(ids[i]);
+      if (reply != replies.end()) {
+        gather.replies.emplace(routes[i], reply->second);
+      } else {
+        gather.stragglers.push_back(routes[i]);
+      }
+    }
+    return gather;
+  }
+
+  template <typename Time>
+  Gather gather_for(Time const& timeout, std::vector<std::string> const& routes,
+                    BasicMessage::ptr_t message, size_t quorum = 0) {
+    return gather_until(system_clock::now() + timeout, routes, message, quorum);
+  }
+
+ private:
+  // Waits for 'n' of the replies in 'ids', keeping or discarding the others
+  template <typename Time>
+  std::unordered_map<std::string, Envelope::ptr_t> receive_until(
+      Time const& deadline, std::vector<std::string> const& ids, size_t n, bool keep_others) {
     std::unordered_map<std::string, Envelope::ptr_t> map;
-    auto n = ids.size();
-    while (n) {
-      auto envelope = receive_until(deadline);
+    map.reserve(ids.size());
+    std::unordered_set<std::string> waiting;
+    waiting.reserve(ids.size());
+    for (auto& id : ids) {
+      auto envelope = take(id);
       if (envelope != nullptr) {
-        auto id = std::find(std::begin(ids), std::end(ids), envelope->Message()->CorrelationId());
-        if (id != std::end(ids)) {
-          map.emplace(*id, envelope);
-          --n;
-        }
+        map.emplace(id, envelope);
       } else {
+        waiting.insert(id);
+      }
+    }
+
+    while (map.size() < n) {
+      auto envelope = receive_until(deadline);
+      if (envelope == nullptr)
         break;
+      auto id = waiting.find(envelope->Message()->CorrelationId());
+      if (id != waiting.end()) {
+        map.emplace(*id, envelope);
+        waiting.erase(id);
+      } else if (keep_others) {
+        keep(envelope);
       }
-    };
+    }
     return map;
   }
 
@@ -0,0 +1,114 @@
+#ifndef __IS_SERVICE_HOST_HPP__
+#define __IS_SERVICE_HOST_HPP__
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ack-batcher.hpp"
+#include "logger.hpp"
+#include "reply-cache.hpp"
+#include "service-provider.hpp"
+
+namespace is {
+
+/*
+  Serves many named providers from a single channel and thread. Each provider
+  keeps its own queue, so instances in other processes still share its load,
+  but one consumer loop drains all of them and one dispatcher routes the
+  requests. Services are exposed as "name.binding", bindings may have
+  wildcards. Expose everything before calling listen().
+
+    ServiceHost host(is::make_channel(uri));
+    for (auto&& camera : cameras)
+      host.expose("camera." + camera.id, "get_pose", get_pose);
+    host.listen();
+*/
+class ServiceHost {
+  Channel::ptr_t channel;
+  const std::string exchange;
+
+  ServiceDispatcher dispatcher;
+  std::vector<std::string> queues;
+  AckBatchers acks;  // One batch per provider consumer
+  uint16_t prefetch;
+
+  void declare(std::string const& name) {
+    if (std::find(queues.begin(), queues.end(), name) != queues.end())
+      return;
+    // passive, durable, exclusive, auto_delete
+    Table arguments{{TableKey("x-expires"), TableValue(30000)},
+                    {TableKey("x-max-length"), TableValue(32)}};
+    channel->DeclareQueue(name, false, false, false, false, arguments);
+    queues.push_back(name);
+  }
+
+ public:
+  ServiceHost(Channel::ptr_t const& channel, std::string const& exchange = "services")
+      : channel(channel), exchange(exchange), dispatcher(exchange), acks(channel), prefetch(1) {
+    // passive durable auto_delete
+    channel->DeclareExchange(exchange, Channel::EXCHANGE_TYPE_TOPIC, false, false, false);
+  }
+
+  void expose(std::string const& name, std::string const& binding, service_handle_t service) {
+    declare(name);
+    auto topic = name + '.' + binding;
+    channel->BindQueue(name, exchange, topic);
+    dispatcher.add(topic, service);
+  }
+
+  // Exposes an idempotent service whose reply is cached, see ReplyCache
+  void expose(std::string const& name, std::string const& binding, service_handle_t service,
+              CachePolicy const& policy) {
+    declare(name);
+    auto topic = name + '.' + binding;
+    channel->BindQueue(name, exchange, topic);
+    dispatcher.add(topic, service, policy);
+  }
+
+  // Thread safe, the next request runs the service again
+  void invalidate(std::string const& name, std::string const& binding) {
+    dispatcher.invalidate(name + '.' + binding);
+  }
+
+  // Maximum number of unacknowledged requests delivered per provider
+  void set_prefetch(uint16_t prefetch) { this->prefetch = prefetch; }
+
+  /*
+    Acknowledges the requests of each provider together every 'messages'
+    requests or 'delay'.
+  */
+  void batch_acks(size_t messages, milliseconds delay = milliseconds(10)) {
+    acks = AckBatchers(channel, messages, delay);
+  }
+
+  ServiceStats const& stats() const { return dispatcher.stats(); }
+
+  std::vector<std::string> const& providers() const { return queues; }
+
+  void listen() {
+    std::vector<std::string> tags;
+    for (auto&& queue : queues) {
+      // no_local, no_ack, exclusive, message_prefetch_count
+      tags.push_back(channel->BasicConsume(queue, "", true, false, false, prefetch));
+    }
+
+    log::info("Listening for service requests of {} providers", queues.size());
+
+    while (1) {
+      Envelope::ptr_t request;
+      if (!channel->BasicConsumeMessage(tags, request, acks.timeout_ms())) {
+        acks.flush();
+        continue;
+      }
+      dispatcher.dispatch(*channel, request);
+      acks.ack(request);
+    }
+  }
+};  // ::ServiceHost
+
+}  // ::is
+
+#endif  // __IS_SERVICE_HOST_HPP__
@@ -4,9 +4,15 @@
 #include <SimpleAmqpClient/SimpleAmqpClient.h>
 #include <atomic>
 #include <exception>
+#include <queue>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include "ack-batcher.hpp"
+#include "helpers.hpp"
 #include "logger.hpp"
+#include "reply-cache.hpp"
+#include "topic-trie.hpp"
 
 namespace is {
 
@@ -19,17 +25,133 @@ struct service_t {
   service_handle_t handle;
 };
 
+struct ServiceStats {
+  std::atomic<uint64_t> requests{0};  // Requests handed to a service
+  std::atomic<uint64_t> expired{0};   // Dropped because their deadline had passed
+  std::atomic<uint64_t> failed{0};    // The service threw an exception
+  std::atomic<uint64_t> invalid{0};   // No service exposed on the routing key
+};
+
+/*
+  Routes requests to the exposed services and publishes their replies. It holds
+  no channel of its own, any type with the BasicPublish interface of
+  AmqpClient::Channel can be used, which allows exercising dispatch offline.
+  Topics may be AMQP patterns, exact topics are always preferred to them.
+*/
+class ServiceDispatcher {
+  const std::string exchange;
+  std::unordered_map<std::string, service_handle_t> map;
+  TopicTrie<service_handle_t> patterns;
+  std::unordered_map<std::string, std::shared_ptr<ReplyCache>> caches;  // topic -> cache
+  ServiceStats counters;
+
+  service_handle_t const* find(std::string const& topic) const {
+    auto service = map.find(topic);
+    if (service != map.end())
+      return &service->second;
+    return patterns.empty() ? nullptr : patterns.find(topic);
+  }
+
+ public:
+  ServiceDispatcher(std::string const& exchange = "services") : exchange(exchange) {}
+
+  void add(std::string const& topic, service_handle_t service) {
+    if (is_pattern(topic)) {
+      patterns.insert(topic, service);
+    } else {
+      map.emplace(topic, service);
+    }
+  }
+
+  // Adds an idempotent service whose reply is cached, see ReplyCache
+  void add(std::string const& topic, service_handle_t service, CachePolicy const& policy) {
+    auto cache = std::make_shared<ReplyCache>(service, policy);
+    caches[topic] = cache;
+    add(topic, [cache](Request request) { return (*cache)(request); });
+  }
+
+  // Thread safe once every service was added, the next request runs the service again
+  void invalidate(std::string const& topic) {
+    auto cache = caches.find(topic);
+    if (cache != caches.end()) {
+      cache->second->invalidate();
+    }
+  }
+
+  ServiceStats const& stats() const { return counters; }
+
+  // Returns false if no service is exposed on the request routing key
+  template <typename Channel>
+  bool dispatch(Channel& channel, Request const& request) {
+    auto service = find(request->RoutingKey());
+    if (service == nullptr) {
+      log::warn("Invalid service requested \"{}\"", request->RoutingKey());
+      ++counters.invalid;
+      return false;
+    }
+
+    if (expired(request)) {
+      log::warn("Expired request \"{}\" dropped", request->RoutingKey());
+      ++counters.expired;
+      return true;
+    }
+
+    log::info("New request \"{}\"", request->RoutingKey());
+
+    ++counters.requests;
+    try {
+      auto reply = (*service)(request);
+
+      if (request->Message()->CorrelationIdIsSet()) {
+        reply->CorrelationId(request->Message()->CorrelationId());
+      }
+
+      if (request->Message()->ReplyToIsSet()) {
+        auto mandatory = true;
+        auto route = request->Message()->ReplyTo();
+
+        auto pos = route.find_first_of(';');
+        if (pos == std::string::npos || pos + 1 > route.size()) {
+          channel.BasicPublish(exchange, route, reply, mandatory);
+        } else {
+          reply->ReplyTo(route.substr(pos + 1));
+          channel.BasicPublish(exchange, route.substr(0, pos), reply, mandatory);
+        }
+      }
+    } catch (std::exception const& e) {
+      ++counters.failed;
+      log::error("Service \"{}\" throwed an exception! \n\t@reason: \"{}\"",
+                 request->RoutingKey(), e.what());
+    }
+    return true;
+  }
+};  // ::ServiceDispatcher
+
 class ServiceProvider {
   const std::string name;
   Channel::ptr_t channel;
   const std::string exchange;
 
-  std::unordered_map<std::string, service_handle_t> map;
+  ServiceDispatcher dispatcher;
+  AckBatcher acks;
+  uint16_t prefetch;
+  bool edf;
+
+  struct Pending {
+    system_clock::time_point deadline;
+    uint64_t sequence;
+    Request request;
+    // Inverted, std::priority_queue keeps the largest element on top
+    bool operator<(Pending const& other) const {
+      return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+    }
+  };
 
  public:
   ServiceProvider(std::string const& name, Channel::ptr_t const& channel,
                   std::string const& exchange = "services")
-      : name(name), channel(channel), exchange(exchange) {
+      : name(name), channel(channel), exchange(exchange), dispatcher(exchange), acks(channel),
+        prefetch(1), edf(false) {
     // passive durable auto_delete
     channel->DeclareExchange(exchange, Channel::EXCHANGE_TYPE_TOPIC, false, false, false);
     // passive, durable, exclusive, auto_delete
@@ -41,49 +163,92 @@ class ServiceProvider {
   void expose(std::string const& binding, service_handle_t service) {
     auto topic = name + '.' + binding;
     channel->BindQueue(name, exchange, topic);
-    map.emplace(topic, service);
+    dispatcher.add(topic, service);
+  }
+
+  // Exposes an idempotent service whose reply is cached, see ReplyCache
+  void expose(std::string const& binding, service_handle_t service, CachePolicy const& policy) {
+    auto topic = name + '.' + binding;
+    channel->BindQueue(name, exchange, topic);
+    dispatcher.add(topic, service, policy);
+  }
+
+  // Thread safe, the next request runs the service again
+  void invalidate(std::string const& binding) { dispatcher.invalidate(name + '.' + binding); }
+
+  /*
+    Prefetches up to 'prefetch' requests and serves the buffered ones in
+    earliest deadline first order instead of FIFO. Requests without deadline
+    are served after the ones with a deadline, in arrival order.
+  */
+  void earliest_deadline_first(uint16_t prefetch = 32) {
+    this->prefetch = prefetch;
+    edf = true;
+  }
+
+  // Maximum number of unacknowledged requests delivered by the broker
+  void set_prefetch(uint16_t prefetch) { this->prefetch = prefetch; }
+
+  // Acknowledges requests together every 'messages' requests or 'delay'
+  void batch_acks(size_t messages, milliseconds delay = milliseconds(10)) {
+    acks = AckBatcher(channel, messages, delay);
   }
 
+  ServiceStats const& stats() const { return dispatcher.stats(); }
+
   void listen() {
-    // no_local, no_ack, exclusive
-    auto tag = channel->BasicConsume(name, "", true, false, false);
+    // no_local, no_ack, exclusive, message_prefetch_count
+    auto tag = channel->BasicConsume(name, "", true, false, false, prefetch);
 
     log::info("Listening for service requests");
 
+    if (acks.batch_size() > 1 && acks.batch_size() >= prefetch) {
+      log::warn("Ack batch of {} with prefetch {}, acks will wait for the delay",
+                acks.batch_size(), prefetch);
+    }
+
+    if (!edf) {
+      while (1) {
+        Envelope::ptr_t request;
+        if (!channel->BasicConsumeMessage(tag, request, acks.timeout_ms())) {
+          acks.flush();
+          continue;
+        }
+        dispatcher.dispatch(*channel, request);
+        acks.ack(request);
+      }
+    }
+
+    std::priority_queue<Pending, std::vector<Pending>> pending;
+    uint64_t sequence = 0;
+    auto push = [&](Request const& request) {
+      auto deadline = system_clock::time_point::max();
+      get_deadline(request->Message(), deadline);
+      pending.push(Pending{deadline, sequence++, request});
+    };
+
+    Envelope::ptr_t request;
     while (1) {
-      auto request = channel->BasicConsumeMessage(tag);
-      auto service = map.find(request->RoutingKey());
-      if (service != map.end()) {
-        log::info("New request \"{}\"", request->RoutingKey());
-
-        try {
-          auto reply = service->second(request);
-
-          if (request->Message()->CorrelationIdIsSet()) {
-            reply->CorrelationId(request->Message()->CorrelationId());
-          }
-
-          if (request->Message()->ReplyToIsSet()) {
-            auto mandatory = true;
-            auto route = request->Message()->ReplyTo();
-
-            auto pos = route.find_first_of(';');
-            if (pos == std::string::npos || pos + 1 > route.size()) {
-              channel->BasicPublish(exchange, route, reply, mandatory);
-            } else {
-              reply->ReplyTo(route.substr(pos + 1));
-              channel->BasicPublish(exchange, route.substr(0, pos), reply, mandatory);
-            }
-          }
-        } catch (std::exception const& e) {
-          log::error("Service \"{}\" throwed an exception! \n\t@reason: \"{}\"",
-                     request->RoutingKey(), e.what());
+      while (pending.empty()) {
+        if (channel->BasicConsumeMessage(tag, request, acks.timeout_ms())) {
+          push(request);
+        } else {
+          acks.flush();
         }
-      } else {
-        log::warn("Invalid service requested \"{}\"", request->RoutingKey());
+      }
+      while (pending.size() < prefetch && channel->BasicConsumeMessage(tag, request, 0)) {
+        push(request);
       }
 
-      channel->BasicAck(request);
+      request = pending.top().request;
+      pending.pop();
+      dispatcher.dispatch(*channel, request);
+      // Served out of order, only batch once every delivered request was served
+      if (pending.empty()) {
+        acks.ack(request);
+      } else {
+        channel->BasicAck(request);
+      }
     }
   }
 }; // ::ServiceProvider
@@ -23,6 +23,22 @@ struct TheoraDecoder {
   enum State { NEW_CONTEXT, RECEIVING_HEADER, WAITING_FIRST_KEYFRAME, RECEIVING_PACKETS };
   State state = NEW_CONTEXT;
 
+  /*
+    Cheaper modes for consumers that only sample the stream (dashboards,
+    archiving): KEYFRAMES_ONLY does not even decode the other frames,
+    'every' N converts only every Nth decoded frame to BGR (0 converts none,
+    see convert()) and 'scale' divides the output width and height. Going
+    back to ALL_FRAMES resumes decoding at the next keyframe.
+  */
+  enum Mode { ALL_FRAMES, KEYFRAMES_ONLY };
+  Mode mode = ALL_FRAMES;
+  unsigned every = 1;
+  int scale = 1;
+
+  bool has_frame = false;  // A frame was decoded with the current context
+  bool stale = false;      // Inter frames were skipped, wait for a keyframe to decode the next ones
+  uint64_t decoded = 0;
+
   void set_headers(std::vector<TheoraPacket> const& headers) { 
     for (auto&& header : headers) {
       decode(header);
@@ -52,6 +68,8 @@ struct TheoraDecoder {
           th_comment_init(&comment);
           setup = nullptr;
           context = nullptr;
+          has_frame = false;
+          stale = false;
           state = RECEIVING_HEADER;
           break;
         }
@@ -81,33 +99,62 @@ struct TheoraDecoder {
         }
 
         case RECEIVING_PACKETS: {
-          if (th_decode_packetin(context, &packet, nullptr)) {
-            log::error("Failed to decode frame");
+          // Inter frames are only needed to reconstruct the frames after them, and once one
+          // is skipped the ones following it have no valid reference until the next keyframe
+          if (th_packet_iskeyframe(&packet) != 1 && (mode == KEYFRAMES_ONLY || stale)) {
+            stale = true;
             return boost::none;
           }
+          stale = false;
 
-          th_ycbcr_buffer buffer;
-          if (th_decode_ycbcr_out(context, buffer)) {
-            log::error("Failed to decode buffer");
+          if (th_decode_packetin(context, &packet, nullptr)) {
+            log::error("Failed to decode frame");
             return boost::none;
           }
+          has_frame = true;
 
-          std::vector<cv::Mat> planes(3);
-          for (size_t i = 0; i < 3; i++) {
-            planes[i] = cv::Mat(buffer[i].height, buffer[i].width, CV_8UC1, buffer[i].data,
-                                buffer[i].stride);
+          if (every == 0 || decoded++ % every != 0) {
+            return boost::none;
           }
-          pyrUp(planes[1], planes[1]);
-          pyrUp(planes[2], planes[2]);
+          return convert();
+        }
+      }
+    }
+  }
 
-          cv::Mat frame;
-          cv::merge(planes, frame);
-          cv::cvtColor(frame, frame, CV_YCrCb2BGR);
+  // Converts the last decoded frame to BGR, e.g. on demand when decoding with every = 0
+  boost::optional<cv::Mat> convert() {
+    if (!has_frame)
+      return boost::none;
+    th_ycbcr_buffer buffer;
+    if (th_decode_ycbcr_out(context, buffer)) {
+      log::error("Failed to decode buffer");
+      return boost::none;
+    }
 
-          return frame;
+    std::vector<cv::Mat> planes(3);
+    for (size_t i = 0; i < 3; i++) {
+      planes[i] = cv::Mat(buffer[i].height, buffer[i].width, CV_8UC1, buffer[i].data,
+                          buffer[i].stride);
+    }
+    if (scale <= 1) {
+      pyrUp(planes[1], planes[1]);
+      pyrUp(planes[2], planes[2]);
+    } else {
+      // Shrinks luma instead of growing chroma, at scale 2 chroma already has the output size
+      cv::Size size(planes[0].cols / scale, planes[0].rows / scale);
+      for (auto&& plane : planes) {
+        if (plane.cols != size.width || plane.rows != size.height) {
+          cv::resize(plane, plane, size, 0, 0, cv::INTER_AREA);
         }
       }
     }
+
+    cv::Mat frame;
+    cv::merge(planes, frame);
+    cv::cvtColor(frame, frame, CV_YCrCb2BGR);
+
+    return frame;
   }
 
   ~TheoraDecoder() {
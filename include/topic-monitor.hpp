@@ -0,0 +1,330 @@
+#ifndef __IS_TOPIC_MONITOR_HPP__
+#define __IS_TOPIC_MONITOR_HPP__
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "helpers.hpp"
+#include "metrics.hpp"
+
+namespace is {
+
+using namespace AmqpClient;
+using namespace std::chrono;
+
+/*
+  Fixed capacity open addressing table of per topic counters. A single thread
+  inserts and records, any number of threads read concurrently without locks:
+  a slot's key is written before its hash is published (release), so readers
+  that see a non zero hash (acquire) also see the key. Slots are never removed.
+*/
+class TopicTable {
+ public:
+  struct Slot {
+    std::atomic<uint64_t> hash{0};  // 0 while the slot is free
+    std::string key;
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<int64_t> subscribers{0};  // Bindings whose key is this topic
+    metrics::LatencyHistogram latency;    // [ns]
+    std::atomic<int64_t> offset{0};       // Publisher clock minus local [ns], refreshed by sample()
+  };
+
+  // Capacity is rounded up to a power of two
+  explicit TopicTable(size_t capacity = 1024) : mask(round_up(capacity) - 1) {
+    slots.reset(new Slot[mask + 1]);
+  }
+
+  size_t capacity() const { return mask + 1; }
+
+  // Keys that did not fit in the table
+  uint64_t overflow() const { return overflows.load(std::memory_order_relaxed); }
+
+  // Writer only, nullptr if the table is full
+  Slot* find_or_insert(std::string const& key) {
+    auto hash = hash_of(key);
+    for (size_t probe = 0, i = hash & mask; probe <= mask; ++probe, i = (i + 1) & mask) {
+      auto&& slot = slots[i];
+      auto current = slot.hash.load(std::memory_order_relaxed);
+      if (current == hash && slot.key == key)
+        return &slot;
+      if (current == 0) {
+        slot.key = key;
+        slot.hash.store(hash, std::memory_order_release);
+        return &slot;
+      }
+    }
+    overflows.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  // Calls f(index, slot) for every used slot, safe from any thread
+  template <typename F>
+  void for_each(F&& f) const {
+    for (size_t i = 0; i <= mask; ++i) {
+      if (slots[i].hash.load(std::memory_order_acquire) != 0) {
+        f(i, slots[i]);
+      }
+    }
+  }
+
+  template <typename F>
+  void for_each(F&& f) {
+    for (size_t i = 0; i <= mask; ++i) {
+      if (slots[i].hash.load(std::memory_order_acquire) != 0) {
+        f(i, slots[i]);
+      }
+    }
+  }
+
+ private:
+  static size_t round_up(size_t n) {
+    size_t capacity = 1;
+    while (capacity < n) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+  static uint64_t hash_of(std::string const& key) {
+    uint64_t hash = std::hash<std::string>()(key);
+    return hash != 0 ? hash : 1;
+  }
+
+  const size_t mask;
+  std::unique_ptr<Slot[]> slots;
+  std::atomic<uint64_t> overflows{0};
+};  // ::TopicTable
+
+/*
+  Per topic message rate, bandwidth and latency (arrival time minus the message
+  timestamp) of a bus. One thread feeds it with record() and record_event(),
+  another periodically calls sample() to get the statistics of the interval
+  since the previous sample.
+*/
+class TopicMonitor {
+ public:
+  struct Row {
+    std::string topic;
+    int64_t subscribers;
+    uint64_t messages;  // Since the monitor started
+    uint64_t bytes;
+    double rate;       // [msgs/s] over the last interval
+    double bandwidth;  // [bytes/s]
+    metrics::LatencyHistogram::Snapshot latency;  // Last interval only [ns]
+  };
+
+  explicit TopicMonitor(std::string const& exchange = "data", size_t capacity = 1024)
+      : exchange(exchange), table(capacity), previous(table.capacity()) {}
+
+  TopicTable const& topics() const { return table; }
+
+  // Data messages dropped because their topic did not fit in the table
+  uint64_t untracked() const { return dropped.load(std::memory_order_relaxed); }
+
+  /*
+    Corrects latencies by the publisher clock offset (publisher minus local
+    [ns], e.g. ClockSync::offset_of) given the topic and the current time.
+    It is called when a topic is first seen and then once per topic at every
+    sample, never per message.
+  */
+  void correct_clocks(std::function<int64_t(std::string const&, int64_t)> offset_of) {
+    offset = std::move(offset_of);
+  }
+
+  // Prefer the "x-steady" timestamp when present, for same host publishers only
+  void use_steady_timestamps(bool enable = true) { steady = enable; }
+
+  // Data messages, 'now' in nanoseconds since epoch
+  void record(Envelope::ptr_t const& envelope,
+              int64_t now = system_clock::now().time_since_epoch().count()) {
+    auto&& key = envelope->RoutingKey();
+    auto slot = table.find_or_insert(key);
+    if (slot == nullptr) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    auto first = slot->messages.fetch_add(1, std::memory_order_relaxed) == 0;
+    auto message = envelope->Message();
+    slot->bytes.fetch_add(message->Body().size(), std::memory_order_relaxed);
+
+    int64_t sent;
+    if (steady && get_steady_timestamp(message, sent)) {
+      auto latency = steady_clock::now().time_since_epoch().count() - sent;
+      slot->latency.record(latency > 0 ? latency : 0);
+    } else if (message->TimestampIsSet()) {
+      auto latency = now - static_cast<int64_t>(message->Timestamp());
+      if (offset && first) {
+        slot->offset.store(offset(key, now), std::memory_order_relaxed);
+      }
+      latency += slot->offset.load(std::memory_order_relaxed);
+      slot->latency.record(latency > 0 ? latency : 0);
+    }
+  }
+
+  /*
+    binding.created / binding.deleted events from amq.rabbitmq.event, used to
+    count subscribers per binding key of the monitored exchange. Bindings of
+    'ignore' (usually the monitor's own queue) are skipped.
+  */
+  void record_event(Envelope::ptr_t const& envelope, std::string const& ignore = "") {
+    auto&& event = envelope->RoutingKey();
+    int delta = event == "binding.created" ? 1 : event == "binding.deleted" ? -1 : 0;
+    auto message = envelope->Message();
+    if (delta == 0 || !message->HeaderTableIsSet())
+      return;
+
+    auto headers = message->HeaderTable();
+    auto header = [&](const char* name) {
+      auto value = headers.find(TableKey(name));
+      return value != headers.end() && value->second.GetType() == TableValue::VT_string
+                 ? value->second.GetString()
+                 : std::string();
+    };
+    if (header("source_name") != exchange || header("destination_name") == ignore)
+      return;
+    auto slot = table.find_or_insert(header("routing_key"));
+    if (slot != nullptr) {
+      slot->subscribers.fetch_add(delta, std::memory_order_relaxed);
+    }
+  }
+
+  // Reader only, rows sorted by decreasing rate
+  std::vector<Row> sample(steady_clock::time_point now = steady_clock::now()) {
+    auto interval = duration<double>(now - last_sample).count();
+    last_sample = now;
+    auto wall = system_clock::now().time_since_epoch().count();
+
+    std::vector<Row> rows;
+    table.for_each([&](size_t i, TopicTable::Slot& slot) {
+      if (offset) {
+        slot.offset.store(offset(slot.key, wall), std::memory_order_relaxed);
+      }
+      auto&& before = previous[i];
+      Row row;
+      row.topic = slot.key;
+      row.subscribers = slot.subscribers.load(std::memory_order_relaxed);
+      row.messages = slot.messages.load(std::memory_order_relaxed);
+      row.bytes = slot.bytes.load(std::memory_order_relaxed);
+      row.rate = interval > 0 ? (row.messages - before.messages) / interval : 0.0;
+      row.bandwidth = interval > 0 ? (row.bytes - before.bytes) / interval : 0.0;
+      auto latency = slot.latency.snapshot();
+      row.latency = latency - before.latency;
+      before = Previous{row.messages, row.bytes, std::move(latency)};
+      rows.push_back(std::move(row));
+    });
+
+    std::sort(rows.begin(), rows.end(), [](Row const& lhs, Row const& rhs) {
+      return lhs.rate != rhs.rate ? lhs.rate > rhs.rate : lhs.topic < rhs.topic;
+    });
+    return rows;
+  }
+
+ private:
+  struct Previous {
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    metrics::LatencyHistogram::Snapshot latency;
+  };
+
+  const std::string exchange;
+  std::function<int64_t(std::string const&, int64_t)> offset;
+  bool steady = false;
+  TopicTable table;
+  std::atomic<uint64_t> dropped{0};
+  std::vector<Previous> previous;  // Indexed by slot, reader only
+  steady_clock::time_point last_sample = steady_clock::now();
+};  // ::TopicMonitor
+
+namespace monitor {
+
+inline double to_ms(uint64_t ns) {
+  return ns / 1e6;
+}
+
+// Human readable bytes per second, e.g. "12.3 MB/s"
+inline std::string bandwidth(double bytes) {
+  const char* units[] = {"B/s", "kB/s", "MB/s", "GB/s"};
+  int unit = 0;
+  while (bytes >= 1000.0 && unit < 3) {
+    bytes /= 1000.0;
+    ++unit;
+  }
+  char text[32];
+  std::snprintf(text, sizeof text, "%.1f %s", bytes, units[unit]);
+  return text;
+}
+
+// Fixed width table, latency columns in milliseconds
+inline std::string render(std::vector<TopicMonitor::Row> const& rows, size_t max_rows = 50) {
+  std::string out;
+  char line[256];
+  std::snprintf(line, sizeof line, "%-40s %5s %10s %12s %9s %9s %9s %9s\n", "TOPIC", "SUBS",
+                "MSGS/S", "BANDWIDTH", "P50", "P90", "P99", "MAX");
+  out += line;
+  for (size_t i = 0; i < rows.size() && i < max_rows; ++i) {
+    auto&& row = rows[i];
+    auto&& latency = row.latency;
+    auto topic = row.topic.size() > 40 ? row.topic.substr(0, 37) + "..." : row.topic;
+    std::snprintf(line, sizeof line, "%-40s %5ld %10.1f %12s %9.2f %9.2f %9.2f %9.2f\n",
+                  topic.c_str(), static_cast<long>(row.subscribers), row.rate,
+                  bandwidth(row.bandwidth).c_str(), to_ms(latency.quantile(0.5)),
+                  to_ms(latency.quantile(0.9)), to_ms(latency.quantile(0.99)),
+                  to_ms(latency.max()));
+    out += line;
+  }
+  if (rows.size() > max_rows) {
+    std::snprintf(line, sizeof line, "... %zu more topics\n", rows.size() - max_rows);
+    out += line;
+  }
+  return out;
+}
+
+inline std::string json_escape(std::string const& text) {
+  std::string escaped;
+  for (auto c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char code[8];
+      std::snprintf(code, sizeof code, "\\u%04x", c);
+      escaped += code;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+// Single line JSON object (one per sample makes the output NDJSON)
+inline std::string json(std::vector<TopicMonitor::Row> const& rows, int64_t timestamp) {
+  std::string out = "{\"timestamp\":" + std::to_string(timestamp) + ",\"topics\":[";
+  char fields[512];
+  for (size_t i = 0; i < rows.size(); ++i) {
+    auto&& row = rows[i];
+    auto&& latency = row.latency;
+    std::snprintf(fields, sizeof fields,
+                  "\"subscribers\":%ld,\"messages\":%lu,\"bytes\":%lu,\"rate\":%.3f,"
+                  "\"bandwidth\":%.3f,\"latency_ms\":{\"count\":%lu,\"mean\":%.3f,\"p50\":%.3f,"
+                  "\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}}",
+                  static_cast<long>(row.subscribers), static_cast<unsigned long>(row.messages),
+                  static_cast<unsigned long>(row.bytes), row.rate, row.bandwidth,
+                  static_cast<unsigned long>(latency.count), latency.mean() / 1e6,
+                  to_ms(latency.quantile(0.5)), to_ms(latency.quantile(0.9)),
+                  to_ms(latency.quantile(0.99)), to_ms(latency.max()));
+    out += (i ? ",{\"topic\":\"" : "{\"topic\":\"") + json_escape(row.topic) + "\"," + fields;
+  }
+  return out + "]}";
+}
+
+}  // ::monitor
+}  // ::is
+
+#endif  // __IS_TOPIC_MONITOR_HPP__
@@ -0,0 +1,141 @@
+#ifndef __IS_TOPIC_TRIE_HPP__
+#define __IS_TOPIC_TRIE_HPP__
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace is {
+
+// True if the topic has AMQP wildcards ('*' one word, '#' zero or more words)
+inline bool is_pattern(std::string const& topic) {
+  return topic.find_first_of("*#") != std::string::npos;
+}
+
+namespace detail {
+
+inline std::vector<std::string> split_words(std::string const& topic) {
+  std::vector<std::string> words;
+  for (size_t pos = 0;;) {
+    auto dot = topic.find('.', pos);
+    words.push_back(topic.substr(pos, dot == std::string::npos ? std::string::npos : dot - pos));
+    if (dot == std::string::npos)
+      return words;
+    pos = dot + 1;
+  }
+}
+
+inline bool match_words(std::vector<std::string> const& pattern, size_t p,
+                        std::vector<std::string> const& key, size_t k) {
+  if (p == pattern.size())
+    return k == key.size();
+  if (pattern[p] == "#") {
+    for (auto rest = k; rest <= key.size(); ++rest) {
+      if (match_words(pattern, p + 1, key, rest))
+        return true;
+    }
+    return false;
+  }
+  return k < key.size() && (pattern[p] == "*" || pattern[p] == key[k]) &&
+         match_words(pattern, p + 1, key, k + 1);
+}
+
+}  // ::detail
+
+// True if the routing key matches the pattern, for code that needs every matching pattern
+inline bool topic_matches(std::string const& pattern, std::string const& key) {
+  if (!is_pattern(pattern))
+    return pattern == key;
+  return detail::match_words(detail::split_words(pattern), 0, detail::split_words(key), 0);
+}
+
+/*
+  Maps AMQP topic patterns to values, one node per dot separated word. Lookups
+  return the most specific matching pattern: at each word an exact match is
+  tried before '*', and '*' before '#'.
+*/
+template <typename T>
+class TopicTrie {
+  struct Node {
+    std::unordered_map<std::string, std::unique_ptr<Node>> children;
+    std::unique_ptr<Node> star;
+    std::unique_ptr<Node> hash;
+    bool has_value = false;
+    T value{};
+  };
+
+  Node root;
+  size_t n = 0;
+
+  // Start of the word after the one starting at 'pos', past key.size() after the last word
+  static size_t next_word(std::string const& key, size_t pos) {
+    auto dot = key.find('.', pos);
+    return dot == std::string::npos ? key.size() + 1 : dot + 1;
+  }
+
+  static Node const* match(Node const* node, std::string const& key, size_t pos) {
+    if (pos > key.size()) {
+      if (node->has_value)
+        return node;
+      // Trailing '#' matching no words
+      return node->hash != nullptr ? match(node->hash.get(), key, pos) : nullptr;
+    }
+
+    auto next = next_word(key, pos);
+    if (!node->children.empty()) {
+      auto child = node->children.find(key.substr(pos, next - pos - 1));
+      if (child != node->children.end()) {
+        if (auto found = match(child->second.get(), key, next))
+          return found;
+      }
+    }
+    if (node->star != nullptr) {
+      if (auto found = match(node->star.get(), key, next))
+        return found;
+    }
+    if (node->hash != nullptr) {
+      // Zero words, one word, ... all the remaining words
+      for (auto rest = pos;; rest = next_word(key, rest)) {
+        if (auto found = match(node->hash.get(), key, rest))
+          return found;
+        if (rest > key.size())
+          break;
+      }
+    }
+    return nullptr;
+  }
+
+ public:
+  // Returns false (keeping the current value) if the pattern was already inserted
+  bool insert(std::string const& pattern, T value) {
+    auto node = &root;
+    for (size_t pos = 0; pos <= pattern.size(); pos = next_word(pattern, pos)) {
+      auto word = pattern.substr(pos, next_word(pattern, pos) - pos - 1);
+      auto&& child = word == "*" ? node->star : word == "#" ? node->hash : node->children[word];
+      if (child == nullptr) {
+        child.reset(new Node);
+      }
+      node = child.get();
+    }
+    if (node->has_value)
+      return false;
+    node->has_value = true;
+    node->value = std::move(value);
+    ++n;
+    return true;
+  }
+
+  // Value of the most specific pattern matching the routing key, nullptr if none
+  T const* find(std::string const& key) const {
+    auto node = match(&root, key, 0);
+    return node != nullptr ? &node->value : nullptr;
+  }
+
+  size_t size() const { return n; }
+  bool empty() const { return n == 0; }
+};  // ::TopicTrie
+
+}  // ::is
+
+#endif  // __IS_TOPIC_TRIE_HPP__
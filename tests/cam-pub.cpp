@@ -1,37 +1,43 @@
+#include "../include/camera-pipeline.hpp"
+#include "../include/clock-sync.hpp"
 #include "../include/is.hpp"
 #include "../include/msgs/camera.hpp"
-#include "../include/theora-encoder.hpp"
 
 #include <opencv2/highgui.hpp>
 
 int main(int, char* []) {
   std::string uri = "amqp://localhost";
-  auto is = is::connect(uri);
 
   cv::VideoCapture webcam(0);
   assert(webcam.isOpened());
   webcam.set(CV_CAP_PROP_FPS, 30);
 
-  is::TheoraEncoder encoder;
+  is::CameraPipeline pipeline(is::connect(uri), "webcam.frame",
+                              [&webcam](cv::Mat& frame) { return webcam.read(frame); });
 
-  std::thread thread([uri, &encoder]() {
-    is::ServiceProvider service("webcam", is::make_channel(uri));
-    service.expose("get_headers", [&encoder](auto) {
-      auto headers = encoder.get_headers();
-      return is::msgpack(headers);  // get_headers is thread safe
-    });
-    service.listen();
-  });
+  // The headers only change with the frame dimensions, serve them from a cache
+  is::ServiceProvider service("webcam", is::make_channel(uri));
+  service.expose("get_headers",
+                 [&pipeline](auto) {
+                   auto headers = pipeline.encoder.get_headers();
+                   return is::msgpack(headers);  // get_headers is thread safe
+                 },
+                 is::CachePolicy{});
+  is::expose_clock(service);  // Lets subscribers correct "webcam.frame" latencies
+  pipeline.on_new_header([&service]() { service.invalidate("get_headers"); });
+  std::thread thread([&service]() { service.listen(); });
 
+  pipeline.start();
   for (;;) {
-    cv::Mat frame;
-    webcam >> frame;
-    auto now = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-
-    for (auto&& packet : encoder.encode(frame)) {
-      auto message = is::msgpack(packet);
-      message->Timestamp(now);
-      is.publish("webcam.frame", is::msgpack(packet));
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+    auto&& stats = pipeline.stats;
+    is::log::info("captured {} dropped {} published {} | latency p99 [ms] encode {} publish {}",
+                  stats.capture.frames.load(), stats.encode.dropped.load(),
+                  stats.publish.frames.load(), stats.encode.latency.snapshot().quantile(0.99) / 1e6,
+                  stats.publish.latency.snapshot().quantile(0.99) / 1e6);
+    for (auto&& pool : is::executor().sample()) {
+      is::log::info("pool {}: {} threads, {:.2f} cores ({:.0f}%)", pool.pool, pool.usage.threads,
+                    pool.cores, 100 * pool.utilization);
     }
   }
-}
\ No newline at end of file
+}
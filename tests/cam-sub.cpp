@@ -1,38 +1,29 @@
+#include "../include/frame-hub.hpp"
 #include "../include/is.hpp"
-#include "../include/msgs/camera.hpp"
-#include "../include/theora-decoder.hpp"
 
 #include <opencv2/highgui.hpp>
 
-using namespace std::chrono_literals;
-
 int main(int, char* []) {
   std::string uri = "amqp://localhost";
-  auto is = is::connect(uri);
-
-  auto frames = is.subscribe("webcam.frame");
-  auto client = is::make_client(is);
 
-  is::TheoraDecoder decoder;
+  // Every component of the process shares the hub's subscription and decoder
+  is::FrameHub hub(uri);
+  auto viewer = hub.subscribe("webcam.frame");  // Latest frame only
+  auto logger = hub.subscribe("webcam.frame", 32, is::FrameQueue::DROP_NEWEST);
+  hub.start();
 
-  for (;;) {
-    auto req_id = client.request("webcam.get_headers", is::msgpack(""));
-    auto reply = client.receive_for(1s, req_id, is::policy::discard_others);
-    if (reply != nullptr) {
-      auto headers = is::msgpack<std::vector<is::msg::camera::TheoraPacket>>(reply);
-      decoder.set_headers(headers);
-      break;
+  std::thread thread([logger]() {
+    for (;;) {
+      auto frame = logger->pop();
+      auto now = std::chrono::system_clock::now().time_since_epoch().count();
+      auto latency = now - static_cast<int64_t>(frame->timestamp);  // Negative if clocks differ
+      is::log::info("frame {} latency {} ms", frame->sequence, latency / 1e6);
     }
-  }
+  });
 
   for (;;) {
-    auto envelope = is.consume(frames);
-    auto packet = is::msgpack<is::msg::camera::TheoraPacket>(envelope);
-    auto maybe_frame = decoder.decode(packet);
-    is::log::info("{}", is::latency(envelope));
-    if (maybe_frame) {
-      cv::imshow("webcam", *maybe_frame);
-      cv::waitKey(1);
-    }
+    auto frame = viewer->pop();
+    cv::imshow("webcam", frame->image);
+    cv::waitKey(1);
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,468 @@
+#include "../include/executor.hpp"
+#include "../include/is.hpp"
+#include "../include/local-bus.hpp"
+#include "../include/metrics.hpp"
+#include "../include/theora-encoder.hpp"
+
+#include <boost/program_options.hpp>
+#include <cstdio>
+#include <iostream>
+
+namespace po = boost::program_options;
+using namespace std::chrono;
+
+/*
+  Load generator: N publishers, S subscribers (each topic is consumed by K of
+  them), M pipelined RPC clients and V echo providers, all in this process,
+  against a broker or an in-process LocalBus. Each role runs on its own
+  executor pool ("load.<role>"), whose thread CPU clocks give the CPU per
+  role. Prints a JSON report.
+*/
+
+// What each role needs from the transport, over the broker or over a LocalBus
+struct Sender {
+  virtual ~Sender() {}
+  // False if the message was not sent (on demand publishers without subscribers)
+  virtual bool send(std::string const& topic, is::BasicMessage::ptr_t const& message) = 0;
+};
+
+struct Receiver {
+  virtual ~Receiver() {}
+  virtual is::Envelope::ptr_t receive(int timeout_ms) = 0;
+};
+
+struct Requester {
+  virtual ~Requester() {}
+  virtual std::string request(std::string const& route, is::BasicMessage::ptr_t message) = 0;
+  virtual is::Envelope::ptr_t receive(int timeout_ms) = 0;
+};
+
+struct Server {
+  virtual ~Server() {}
+  // Broker providers never return, their threads are detached
+  virtual void serve(std::atomic<bool> const& running) = 0;
+};
+
+struct BrokerSender : Sender {
+  is::Connection is;
+  BrokerSender(std::string const& uri) : is(is::make_channel(uri)) {}
+  bool send(std::string const& topic, is::BasicMessage::ptr_t const& message) override {
+    return is.publish(topic, message);
+  }
+};
+
+// Only publishes while the topic has subscribers, the way DataPublisher nodes do
+struct OnDemandSender : Sender {
+  is::DataPublisher publisher;
+  is::BasicMessage::ptr_t next;
+  bool added = false;
+  OnDemandSender(std::string const& uri) : publisher(is::Connection(is::make_channel(uri))) {}
+  bool send(std::string const& topic, is::BasicMessage::ptr_t const& message) override {
+    if (!added) {
+      publisher.add(topic, [this]() { return next; });
+      added = true;
+    }
+    next = message;
+    return publisher.publish() > 0;
+  }
+};
+
+struct BrokerReceiver : Receiver {
+  is::Connection is;
+  is::QueueInfo queue;
+  BrokerReceiver(std::string const& uri, std::vector<std::string> const& topics, int queue_size)
+      : is(is::make_channel(uri)), queue(is.subscribe(topics, "data", queue_size)) {}
+  is::Envelope::ptr_t receive(int timeout_ms) override {
+    return is.consume_for(queue, milliseconds(timeout_ms));
+  }
+};
+
+struct BrokerRequester : Requester {
+  is::ServiceClient client;
+  BrokerRequester(std::string const& uri) : client(is::make_channel(uri)) {}
+  std::string request(std::string const& route, is::BasicMessage::ptr_t message) override {
+    return client.request(route, message);
+  }
+  is::Envelope::ptr_t receive(int timeout_ms) override {
+    return client.receive_for(milliseconds(timeout_ms));
+  }
+};
+
+struct BrokerServer : Server {
+  is::ServiceProvider provider;
+  BrokerServer(std::string const& uri, is::service_handle_t service)
+      : provider("load.rpc", is::make_channel(uri)) {
+    provider.expose("echo", service);
+  }
+  void serve(std::atomic<bool> const&) override { provider.listen(); }
+};
+
+struct LocalSender : Sender {
+  is::LocalBus& bus;
+  LocalSender(is::LocalBus& bus) : bus(bus) {}
+  bool send(std::string const& topic, is::BasicMessage::ptr_t const& message) override {
+    bus.BasicPublish("data", topic, message);
+    return true;
+  }
+};
+
+struct LocalReceiver : Receiver {
+  std::shared_ptr<is::LocalBus::Queue> queue;
+  LocalReceiver(is::LocalBus& bus, std::vector<std::string> const& topics, int queue_size)
+      : queue(bus.declare("", queue_size)) {
+    for (auto&& topic : topics) {
+      bus.bind(queue->name(), "data", topic);
+    }
+  }
+  is::Envelope::ptr_t receive(int timeout_ms) override {
+    is::Envelope::ptr_t envelope;
+    queue->consume(envelope, timeout_ms);
+    return envelope;
+  }
+};
+
+struct LocalRequester : Requester {
+  is::LocalBus& bus;
+  std::shared_ptr<is::LocalBus::Queue> replies;
+  uint64_t correlation_id = 0;
+  LocalRequester(is::LocalBus& bus) : bus(bus), replies(bus.declare("", 1024)) {
+    bus.bind(replies->name(), "services", replies->name());
+  }
+  std::string request(std::string const& route, is::BasicMessage::ptr_t message) override {
+    auto id = std::to_string(correlation_id++);
+    message->CorrelationId(id);
+    message->ReplyTo(replies->name());
+    bus.BasicPublish("services", route, message);
+    return id;
+  }
+  is::Envelope::ptr_t receive(int timeout_ms) override {
+    is::Envelope::ptr_t envelope;
+    replies->consume(envelope, timeout_ms);
+    return envelope;
+  }
+};
+
+// Same dispatch code as ServiceProvider, replies go through the bus
+struct LocalServer : Server {
+  is::LocalBus& bus;
+  std::shared_ptr<is::LocalBus::Queue> requests;
+  is::ServiceDispatcher dispatcher;
+  LocalServer(is::LocalBus& bus, is::service_handle_t service)
+      : bus(bus), requests(bus.declare("load.rpc", 32)), dispatcher("services") {
+    bus.bind("load.rpc", "services", "load.rpc.echo");
+    dispatcher.add("load.rpc.echo", service);
+  }
+  void serve(std::atomic<bool> const& running) override {
+    while (running) {
+      is::Envelope::ptr_t request;
+      if (requests->consume(request, 100)) {
+        dispatcher.dispatch(bus, request);
+      }
+    }
+  }
+};
+
+struct Counters {
+  std::atomic<uint64_t> messages{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> skipped{0};  // Sends without subscribers, or RPC timeouts
+  is::metrics::LatencyHistogram latency;  // [ns]
+};
+
+// Pre-encoded packets of a moving gradient, one keyframe interval so they can be looped
+std::vector<std::string> theora_bodies(int width, int height) {
+  is::TheoraEncoder encoder;
+  std::vector<std::string> bodies;
+  for (int i = 0; i < 64; ++i) {
+    cv::Mat frame(height, width, CV_8UC3);
+    for (int r = 0; r < height; ++r) {
+      for (int c = 0; c < width; ++c) {
+        frame.at<cv::Vec3b>(r, c) = cv::Vec3b((r + i) % 256, (c + 2 * i) % 256, (r + c) % 256);
+      }
+    }
+    for (auto&& packet : encoder.encode(frame)) {
+      if (!packet.new_header) {
+        bodies.push_back(is::msgpack(packet)->Body());
+      }
+    }
+  }
+  return bodies;
+}
+
+std::string latency_json(is::metrics::LatencyHistogram::Snapshot const& latency) {
+  char text[256];
+  std::snprintf(text, sizeof text,
+                "{\"count\":%lu,\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,"
+                "\"p999\":%.3f,\"max\":%.3f}",
+                static_cast<unsigned long>(latency.count), latency.mean() / 1e6,
+                latency.quantile(0.5) / 1e6, latency.quantile(0.9) / 1e6,
+                latency.quantile(0.99) / 1e6, latency.quantile(0.999) / 1e6,
+                latency.max() / 1e6);
+  return text;
+}
+
+int main(int argc, char* argv[]) {
+  std::string uri, theora;
+  double duration, rate;
+  int publishers, subscribers, fanout, clients, pipeline, providers, queue_size, timeout_ms;
+  size_t payload, request_size;
+
+  po::options_description description("Generates publish/subscribe and RPC load");
+  auto&& options = description.add_options();
+  options("help,h", "show available options");
+  options("uri,u", po::value<std::string>(&uri)->default_value("amqp://localhost"), "broker uri");
+  options("local,l", "use an in-process stand-in instead of the broker");
+  options("duration,d", po::value<double>(&duration)->default_value(10.0), "load duration [s]");
+  options("publishers,p", po::value<int>(&publishers)->default_value(4), "publishers");
+  options("rate,r", po::value<double>(&rate)->default_value(30.0),
+          "messages per second of each publisher, 0 publishes as fast as possible");
+  options("payload,b", po::value<size_t>(&payload)->default_value(1024), "message size [bytes]");
+  options("theora,t", po::value<std::string>(&theora)->default_value(""),
+          "publish a synthetic Theora stream of this size instead, e.g. 640x480");
+  options("on-demand", "publish through DataPublisher, only while topics have subscribers");
+  options("subscribers,s", po::value<int>(&subscribers)->default_value(4), "subscribers");
+  options("fanout,f", po::value<int>(&fanout)->default_value(1), "subscribers per topic");
+  options("queue-size,q", po::value<int>(&queue_size)->default_value(32),
+          "subscriber queue length, older messages are dropped");
+  options("clients,c", po::value<int>(&clients)->default_value(2), "RPC clients");
+  options("pipeline", po::value<int>(&pipeline)->default_value(8),
+          "requests each client keeps in flight");
+  options("providers", po::value<int>(&providers)->default_value(1), "echo service providers");
+  options("request-size", po::value<size_t>(&request_size)->default_value(128),
+          "request size [bytes]");
+  options("timeout", po::value<int>(&timeout_ms)->default_value(1000),
+          "requests without reply after this many milliseconds are counted as timeouts");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, description), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << description << std::endl;
+    return 0;
+  }
+  // Keep stdout parseable
+  is::logger()->set_level(spdlog::level::warn);
+  bool local = vm.count("local") > 0;
+  bool on_demand = vm.count("on-demand") > 0;
+  fanout = std::min(fanout, subscribers);
+
+  std::vector<std::string> bodies;
+  int width, height;
+  if (!theora.empty()) {
+    if (std::sscanf(theora.c_str(), "%dx%d", &width, &height) != 2) {
+      is::log::critical("Invalid Theora frame size \"{}\"", theora);
+    }
+    bodies = theora_bodies(width, height);
+    if (bodies.empty()) {
+      is::log::critical("Failed to encode a {}x{} Theora stream", width, height);
+    }
+  } else {
+    bodies.push_back(std::string(payload, 'x'));
+  }
+
+  is::LocalBus bus;
+  auto sender = [&]() -> std::unique_ptr<Sender> {
+    if (local)
+      return std::unique_ptr<Sender>(new LocalSender(bus));
+    if (on_demand)
+      return std::unique_ptr<Sender>(new OnDemandSender(uri));
+    return std::unique_ptr<Sender>(new BrokerSender(uri));
+  };
+  auto receiver = [&](std::vector<std::string> const& topics) -> std::unique_ptr<Receiver> {
+    if (local)
+      return std::unique_ptr<Receiver>(new LocalReceiver(bus, topics, queue_size));
+    return std::unique_ptr<Receiver>(new BrokerReceiver(uri, topics, queue_size));
+  };
+  auto requester = [&]() -> std::unique_ptr<Requester> {
+    if (local)
+      return std::unique_ptr<Requester>(new LocalRequester(bus));
+    return std::unique_ptr<Requester>(new BrokerRequester(uri));
+  };
+
+  Counters published, received, replied, served;
+  std::vector<std::atomic<uint64_t>> sent(publishers);  // Per publisher, for expected deliveries
+  std::atomic<bool> running{true};    // Publishers, clients and local providers
+  std::atomic<bool> receiving{true};  // Subscribers, stopped after draining
+  auto&& executor = is::executor();
+  std::vector<std::thread> threads, subscriber_threads;
+
+  auto echo = [&served](is::Request request) {
+    served.messages.fetch_add(1, std::memory_order_relaxed);
+    return is::BasicMessage::Create(request->Message()->Body());
+  };
+  std::vector<std::unique_ptr<Server>> servers;
+  for (int i = 0; i < providers && clients > 0; ++i) {
+    if (local) {
+      servers.emplace_back(new LocalServer(bus, echo));
+    } else {
+      servers.emplace_back(new BrokerServer(uri, echo));
+    }
+    auto server = servers.back().get();
+    auto thread = executor.spawn("load.serve", [server, &running]() { server->serve(running); });
+    if (local) {
+      threads.push_back(std::move(thread));
+    } else {
+      thread.detach();
+    }
+  }
+
+  // Subscriber s consumes the topics of publishers s, s - 1, ..., s - fanout + 1 (modulo)
+  for (int s = 0; s < subscribers; ++s) {
+    std::vector<std::string> topics;
+    for (int p = 0; p < publishers; ++p) {
+      if (((s - p) % subscribers + subscribers) % subscribers < fanout) {
+        topics.push_back("load.data." + std::to_string(p));
+      }
+    }
+    if (topics.empty())
+      continue;
+    std::shared_ptr<Receiver> endpoint = receiver(topics);
+    subscriber_threads.push_back(executor.spawn("load.subscribe", [&, endpoint]() {
+      while (receiving) {
+        auto envelope = endpoint->receive(100);
+        if (envelope == nullptr)
+          continue;
+        auto now = system_clock::now().time_since_epoch().count();
+        auto timestamp = static_cast<int64_t>(envelope->Message()->Timestamp());
+        received.latency.record(now > timestamp ? now - timestamp : 0);
+        received.messages.fetch_add(1, std::memory_order_relaxed);
+        received.bytes.fetch_add(envelope->Message()->Body().size(), std::memory_order_relaxed);
+      }
+    }));
+  }
+  // Let the broker create the bindings before publishing
+  std::this_thread::sleep_for(milliseconds(local ? 0 : 500));
+
+  auto start = steady_clock::now();
+  auto deadline = start + duration_cast<nanoseconds>(std::chrono::duration<double>(duration));
+  auto baseline = executor.sample();
+
+  for (int p = 0; p < publishers; ++p) {
+    std::shared_ptr<Sender> endpoint = sender();
+    threads.push_back(executor.spawn("load.publish", [&, endpoint, p]() {
+      auto topic = "load.data." + std::to_string(p);
+      auto period = rate > 0 ? duration_cast<nanoseconds>(std::chrono::duration<double>(1 / rate))
+                             : nanoseconds(0);
+      auto next = steady_clock::now();
+      for (size_t i = p; running && steady_clock::now() < deadline; ++i) {
+        auto message = is::BasicMessage::Create(bodies[i % bodies.size()]);
+        message->ContentEncoding("msgpack");
+        is::set_timestamp(message);
+        if (endpoint->send(topic, message)) {
+          sent[p].fetch_add(1, std::memory_order_relaxed);
+          published.messages.fetch_add(1, std::memory_order_relaxed);
+          published.bytes.fetch_add(message->Body().size(), std::memory_order_relaxed);
+        } else {
+          published.skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (period.count() > 0) {
+          next += period;
+          std::this_thread::sleep_until(next);
+        }
+      }
+    }));
+  }
+
+  for (int c = 0; c < clients && providers > 0; ++c) {
+    std::shared_ptr<Requester> endpoint = requester();
+    threads.push_back(executor.spawn("load.rpc", [&, endpoint]() {
+      std::unordered_map<std::string, steady_clock::time_point> in_flight;
+      auto body = std::string(request_size, 'x');
+      while (running && steady_clock::now() < deadline) {
+        while (static_cast<int>(in_flight.size()) < pipeline) {
+          auto id = endpoint->request("load.rpc.echo", is::BasicMessage::Create(body));
+          in_flight.emplace(id, steady_clock::now());
+        }
+        auto reply = endpoint->receive(10);
+        auto now = steady_clock::now();
+        if (reply != nullptr) {
+          auto request = in_flight.find(reply->Message()->CorrelationId());
+          if (request != in_flight.end()) {
+            replied.latency.record(duration_cast<nanoseconds>(now - request->second).count());
+            replied.messages.fetch_add(1, std::memory_order_relaxed);
+            in_flight.erase(request);
+          }
+        }
+        for (auto request = in_flight.begin(); request != in_flight.end();) {
+          if (now - request->second > milliseconds(timeout_ms)) {
+            replied.skipped.fetch_add(1, std::memory_order_relaxed);
+            request = in_flight.erase(request);
+          } else {
+            ++request;
+          }
+        }
+      }
+    }));
+  }
+
+  std::this_thread::sleep_until(deadline);
+  running = false;
+  for (auto&& thread : threads) {
+    thread.join();
+  }
+  auto stopped = std::min(steady_clock::now(), deadline);
+  auto elapsed = std::chrono::duration<double>(stopped - start).count();
+  // Messages still on their way are delivered late rather than dropped
+  std::this_thread::sleep_for(seconds(1));
+  receiving = false;
+  for (auto&& thread : subscriber_threads) {
+    thread.join();
+  }
+
+  uint64_t expected = 0;
+  for (auto&& count : sent) {
+    expected += count.load() * fanout;
+  }
+  auto cpu = [&](std::string const& pool) {
+    uint64_t before = 0, after = 0;
+    for (auto&& sample : baseline) {
+      before += sample.pool == pool ? sample.usage.cpu : 0;
+    }
+    for (auto&& sample : executor.sample()) {
+      after += sample.pool == pool ? sample.usage.cpu : 0;
+    }
+    return (after - before) / 1e9;
+  };
+  auto per_second = [&](uint64_t n) { return n / elapsed; };
+
+  char text[512];
+  std::string report;
+  std::snprintf(text, sizeof text,
+                "{\"mode\":\"%s\",\"duration_s\":%.3f,\"publish\":{\"threads\":%d,\"messages\":%lu,"
+                "\"skipped\":%lu,\"rate\":%.1f,\"bandwidth\":%.1f,\"cpu_s\":%.3f},",
+                local ? "local" : "broker", elapsed, publishers,
+                static_cast<unsigned long>(published.messages.load()),
+                static_cast<unsigned long>(published.skipped.load()),
+                per_second(published.messages), per_second(published.bytes),
+                cpu("load.publish"));
+  report += text;
+
+  auto delivered = received.messages.load();
+  std::snprintf(text, sizeof text,
+                "\"subscribe\":{\"threads\":%zu,\"fanout\":%d,\"expected\":%lu,\"messages\":%lu,"
+                "\"dropped\":%lu,\"rate\":%.1f,\"bandwidth\":%.1f,\"cpu_s\":%.3f,\"latency_ms\":",
+                subscriber_threads.size(), fanout, static_cast<unsigned long>(expected),
+                static_cast<unsigned long>(delivered),
+                static_cast<unsigned long>(expected > delivered ? expected - delivered : 0),
+                per_second(delivered), per_second(received.bytes), cpu("load.subscribe"));
+  report += text + latency_json(received.latency.snapshot()) + "},";
+
+  std::snprintf(text, sizeof text,
+                "\"rpc\":{\"threads\":%d,\"pipeline\":%d,\"replies\":%lu,\"timeouts\":%lu,"
+                "\"rate\":%.1f,\"cpu_s\":%.3f,\"latency_ms\":",
+                providers > 0 ? clients : 0, pipeline,
+                static_cast<unsigned long>(replied.messages.load()),
+                static_cast<unsigned long>(replied.skipped.load()), per_second(replied.messages),
+                cpu("load.rpc"));
+  report += text + latency_json(replied.latency.snapshot()) + "},";
+
+  std::snprintf(text, sizeof text, "\"serve\":{\"threads\":%d,\"requests\":%lu,\"cpu_s\":%.3f}}",
+                clients > 0 ? providers : 0, static_cast<unsigned long>(served.messages.load()),
+                cpu("load.serve"));
+  report += text;
+  std::cout << report << std::endl;
+
+  // Broker providers never return
+  std::_Exit(0);
+}
@@ -0,0 +1,43 @@
+#include "../include/is.hpp"
+#include "../include/recording.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[]) {
+  std::string uri, directory, exchange;
+  std::vector<std::string> topics;
+  int64_t duration;
+  size_t segment_mb;
+
+  po::options_description description("Records bus traffic to a directory");
+  auto&& options = description.add_options();
+  options("help,h", "show available options");
+  options("uri,u", po::value<std::string>(&uri)->default_value("amqp://localhost"), "broker uri");
+  options("output,o", po::value<std::string>(&directory)->default_value("recording"),
+          "recording directory");
+  options("topic,t", po::value<std::vector<std::string>>(&topics)->multitoken(),
+          "topic patterns to record, e.g. webcam.* (default #)");
+  options("exchange,e", po::value<std::string>(&exchange)->default_value("data"), "exchange");
+  options("duration,d", po::value<int64_t>(&duration)->default_value(60), "duration [s]");
+  options("segment,s", po::value<size_t>(&segment_mb)->default_value(256), "segment size [MB]");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, description), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << description << std::endl;
+    return 0;
+  }
+  if (topics.empty()) {
+    topics.push_back("#");
+  }
+
+  is::recording::Recorder recorder(is::connect(uri), directory, topics, exchange, 4096,
+                                   segment_mb << 20);
+  auto n = recorder.record_for(std::chrono::seconds(duration));
+  is::log::info("Recorded {} messages to \"{}\"", n, directory);
+}
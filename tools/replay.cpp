@@ -0,0 +1,45 @@
+#include "../include/is.hpp"
+#include "../include/recording.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[]) {
+  std::string uri, directory, exchange;
+  double speed, skip;
+  int loops;
+
+  po::options_description description("Republishes a recording");
+  auto&& options = description.add_options();
+  options("help,h", "show available options");
+  options("uri,u", po::value<std::string>(&uri)->default_value("amqp://localhost"), "broker uri");
+  options("input,i", po::value<std::string>(&directory)->default_value("recording"),
+          "recording directory");
+  options("exchange,e", po::value<std::string>(&exchange)->default_value("data"), "exchange");
+  options("speed,s", po::value<double>(&speed)->default_value(1.0),
+          "replay speed, 0 publishes as fast as possible");
+  options("skip", po::value<double>(&skip)->default_value(0.0),
+          "start this many seconds into the recording");
+  options("loops,l", po::value<int>(&loops)->default_value(1), "number of replays");
+  options("keep-timestamps", "keep the recorded message timestamps");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, description), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << description << std::endl;
+    return 0;
+  }
+
+  auto is = is::connect(uri);
+  is::recording::Replayer replayer(directory);
+  auto from = replayer.records().begin_time() + static_cast<uint64_t>(skip * 1e9);
+  for (int i = 0; i < loops; ++i) {
+    auto n = replayer.replay(is, speed, from, std::numeric_limits<uint64_t>::max(), exchange,
+                             vm.count("keep-timestamps") > 0);
+    is::log::info("Replayed {} messages", n);
+  }
+}
@@ -0,0 +1,114 @@
+#include "../include/clock-sync.hpp"
+#include "../include/is.hpp"
+#include "../include/topic-monitor.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+
+namespace po = boost::program_options;
+using namespace std::chrono;
+
+int main(int argc, char* argv[]) {
+  std::string uri, exchange;
+  std::vector<std::string> topics, peers;
+  double interval;
+  int64_t duration;
+  size_t capacity, rows;
+
+  po::options_description description("Shows per topic rates, bandwidth and latency");
+  auto&& options = description.add_options();
+  options("help,h", "show available options");
+  options("uri,u", po::value<std::string>(&uri)->default_value("amqp://localhost"), "broker uri");
+  options("topic,t", po::value<std::vector<std::string>>(&topics)->multitoken(),
+          "topic patterns to monitor, e.g. webcam.* (default #)");
+  options("exchange,e", po::value<std::string>(&exchange)->default_value("data"), "exchange");
+  options("interval,i", po::value<double>(&interval)->default_value(1.0), "refresh interval [s]");
+  options("duration,d", po::value<int64_t>(&duration)->default_value(0),
+          "stop after this many seconds, 0 runs until interrupted");
+  options("rows,r", po::value<size_t>(&rows)->default_value(40), "topics shown");
+  options("capacity,c", po::value<size_t>(&capacity)->default_value(4096),
+          "maximum number of topics tracked");
+  options("json,j", "print one JSON object per interval instead of the table");
+  options("sync,s", po::value<std::vector<std::string>>(&peers)->multitoken(),
+          "correct latencies by the clocks of these peers (exposing sync_clock)");
+  options("steady", "use the steady timestamps of same host publishers when present");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, description), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << description << std::endl;
+    return 0;
+  }
+  if (topics.empty()) {
+    topics.push_back("#");
+  }
+  bool json = vm.count("json") > 0;
+  if (json) {
+    // Keep stdout parseable
+    is::logger()->set_level(spdlog::level::warn);
+  }
+
+  is::TopicMonitor monitor(exchange, capacity);
+  monitor.use_steady_timestamps(vm.count("steady") > 0);
+
+  std::unique_ptr<is::ClockSync> clocks;
+  if (!peers.empty()) {
+    clocks.reset(new is::ClockSync(uri, peers));
+    clocks->start();
+    monitor.correct_clocks([&clocks](std::string const& topic, int64_t now) {
+      return clocks->offset_of(topic, now);
+    });
+  }
+  std::atomic<bool> running{true};
+
+  // Both subscriptions share a channel, a single consumer drains them
+  auto is = is::connect(uri);
+  auto data = is.subscribe(topics, exchange, 65536);
+  auto events = is.subscribe("binding.*", "amq.rabbitmq.event", 1024);
+
+  std::thread consumer([&]() {
+    try {
+      while (running) {
+        is::Envelope::ptr_t envelope;
+        if (!is.channel->BasicConsumeMessage(envelope, 100))
+          continue;
+        if (envelope->ConsumerTag() == data.tag) {
+          monitor.record(envelope);
+        } else if (envelope->ConsumerTag() == events.tag) {
+          monitor.record_event(envelope, data.name);
+        }
+      }
+    } catch (std::exception const& e) {
+      is::log::error("Monitor stopped \n\t@reason: \"{}\"", e.what());
+      running = false;
+    }
+  });
+
+  auto period = duration_cast<nanoseconds>(std::chrono::duration<double>(interval));
+  auto deadline = steady_clock::now() + seconds(duration);
+  auto next = steady_clock::now() + period;
+  while (running && (duration == 0 || next <= deadline)) {
+    std::this_thread::sleep_until(next);
+    next += period;
+
+    auto sample = monitor.sample();
+    if (json) {
+      std::cout << is::monitor::json(sample, system_clock::now().time_since_epoch().count())
+                << std::endl;
+    } else {
+      // Clear the screen and move the cursor home before redrawing
+      std::cout << "\033[2J\033[H" << is::monitor::render(sample, rows);
+      if (monitor.untracked()) {
+        std::cout << monitor.untracked() << " messages of untracked topics\n";
+      }
+      std::cout << std::flush;
+    }
+  }
+
+  running = false;
+  consumer.join();
+  is.unsubscribe(data);
+  is.unsubscribe(events);
+}